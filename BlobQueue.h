@@ -0,0 +1,345 @@
+#ifndef BLOB_QUEUE_H_
+#define BLOB_QUEUE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "PersistentQueue.h"
+
+//============================Start BlobQueue Class==========================//
+/* A durable queue of variable-length byte strings. Every blob is stored inline
+ * after the header of its node, in an allocation of whole cache lines. The
+ * header and the bytes are written together with streaming stores, so their
+ * lines are never read for ownership or flushed, and one fence persists the
+ * node before it is linked. Otherwise it runs the algorithm of the Durable
+ * policy of PersistentQueue: a node is claimed with the id of the dequeuing
+ * thread, and the removed node is saved in the removedBlobs array.
+ * A dequeue returns a view of the bytes in the node, without copying them.
+ * The view stays valid until the thread releases it. Since this version DOES
+ * NOT contain any memory management, the nodes are never reused, and release
+ * only records that the thread is done with the blob: after a crash,
+ * unreleased returns the blob the thread dequeued last if it did not release
+ * it, so it can be handled again.
+ */
+template <class Flush = Clflush> class BlobQueue
+    : protected PersistHooks<Flush> {
+
+    typedef PersistHooks<Flush> Hooks;
+
+  public:
+
+    //============================Start Blob Class===========================//
+    /* The header of a node. The bytes of the blob follow it directly, and
+     * the node takes as many whole cache lines as they need. It contains the
+     * following fields:
+     * next     - a pointer to the next node in the queue.
+     * threadID - the id of the thread that dequeued the node, or -1.
+     * size     - the number of bytes of the blob.
+     */
+    class Blob {
+      public:
+        std::atomic<Blob*> next;
+        std::atomic<int> threadID;
+        uint32_t size;
+        Blob(uint32_t s) : next(nullptr), threadID(-1), size(s) {}
+        const char* bytes() const { return (const char*)(this + 1); }
+    };
+    //=============================End Blob Class============================//
+
+    //=========================Start RemovedBlob Class=======================//
+    /* The entry of the removedBlobs array for one dequeue, like the
+     * RemovedValue of PersistentQueue. It contains the following fields:
+     * blob     - the removed node, null until the dequeue takes one.
+     * empty    - set if the dequeue found the queue empty.
+     * released - set once the thread released the view of the blob.
+     * previous - the node that the thread removed before this dequeue, or
+     *            null. Recovery tells by it whether the last node the thread
+     *            claimed was taken by this dequeue.
+     */
+    class RemovedBlob {
+      public:
+        std::atomic<Blob*> blob;
+        bool empty;
+        bool released;
+        Blob* previous;
+        RemovedBlob()
+            : blob(nullptr), empty(false), released(false), previous(nullptr) {}
+    };
+    //==========================End RemovedBlob Class========================//
+
+    //==========================Start BlobView Class=========================//
+    /* The bytes of a dequeued blob. An empty view stands for an empty queue.
+     */
+    class BlobView {
+      public:
+        BlobView(const Blob* b = nullptr) : blob(b) {}
+        explicit operator bool() const { return blob != nullptr; }
+        const char* data() const { return blob->bytes(); }
+        uint32_t size() const { return blob->size; }
+      private:
+        const Blob* blob;
+    };
+    //===========================End BlobView Class==========================//
+
+    static_assert(sizeof(Blob) % sizeof(long long) == 0,
+                  "The bytes of a blob must start at an 8-byte boundary");
+
+    // Each thread id has an entrance where it saves the last node it
+    // dequeued. Recovery reads it through unreleased.
+    PerThread<RemovedBlob*, Flush> removedBlobs;
+
+    /* The constructor of the queue. Makes the head and tail point to a durable
+     * empty dummy node.
+     */
+    BlobQueue() {
+        Blob* dummy = createBlob(nullptr, 0);
+        head = tail = dummy;
+        barrier(&head);
+        barrier(&tail);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Enqueues a copy of the size bytes at data. The node is written with
+     * streaming stores and fenced once, and then linked like a node of the
+     * Durable policy.
+     */
+    void enq(const void* data, uint32_t size) {
+        TRACE_OP("BlobQueue::enq");
+        QUEUE_STAT(statOperations);
+        Blob* node = createBlob(data, size);
+        while (true) {
+            QUEUE_STAT(statIterations);
+            Blob* last = tail.load();
+            Blob* next = last->next.load();
+            if (last == tail.load()) {
+                if (next == nullptr) {
+                    if (COUNT_CAS(statCasNext,
+                                  last->next.compare_exchange_strong(next, node))) {
+                        TRACE_STORE(&last->next);
+                        barrierOpt(&last->next);
+                        COUNT_CAS(statCasTail,
+                                  tail.compare_exchange_strong(last, node));
+                        return;
+                    }
+                } else {
+                    // If next is a node, help in promoting the tail
+                    QUEUE_STAT(statHelpTail);
+                    barrierOpt(&last->next);
+                    COUNT_CAS(statCasTail, tail.compare_exchange_strong(last, next));
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Tries to dequeue a node. Returns a view of its bytes, or an empty view
+     * if the queue is empty. The node is first stamped with the threadID and
+     * then saved in the thread's entry of removedBlobs, like a value of the
+     * Durable policy.
+     */
+    BlobView deq(int threadID = currentThreadID()) {
+        TRACE_OP("BlobQueue::deq");
+        QUEUE_STAT(statOperations);
+        RemovedBlob* removed = allocNode<RemovedBlob>();
+        // Only this thread replaces its entry, and its node is final
+        RemovedBlob* last = removedBlobs[threadID];
+        if (last != nullptr) {
+            Blob* lastBlob = last->blob.load(std::memory_order_relaxed);
+            removed->previous = lastBlob != nullptr ? lastBlob : last->previous;
+        }
+        TRACE_STORE(removed);
+        barrier(removed);
+        // Helpers read the entry while it is replaced
+        __atomic_store_n(&removedBlobs[threadID], removed, __ATOMIC_RELEASE);
+        TRACE_STORE(&removedBlobs[threadID]);
+        barrier(&removedBlobs[threadID]);
+        while (true) {
+            QUEUE_STAT(statIterations);
+            Blob* first = head.load();
+            Blob* last = tail.load();
+            Blob* next = first->next.load();
+            if (first == head.load()) {
+                if (next == nullptr) {  // The queue is empty
+                    removed->empty = true;
+                    TRACE_STORE(&removed->empty);
+                    barrier(&removed->empty);
+                    QUEUE_STAT(statEmpty);
+                    return BlobView();
+                }
+                if (first == last) {
+                    barrierOpt(&last->next);
+                    // If next is a node, help promote the tail
+                    QUEUE_STAT(statHelpTail);
+                    COUNT_CAS(statCasTail, tail.compare_exchange_strong(last, next));
+                    continue;
+                }
+                int valid = -1;
+                if (COUNT_CAS(statCasClaim,
+                              next->threadID.compare_exchange_strong(valid, threadID))) {
+                    TRACE_STORE(&next->threadID);
+                    barrier(&next->threadID);
+                    removed->blob = next;
+                    TRACE_STORE(&removed->blob);
+                    barrierOpt(&removed->blob);
+                    COUNT_CAS(statCasHead, head.compare_exchange_strong(first, next));
+                    return BlobView(next);
+                } else {
+                    RemovedBlob* other = __atomic_load_n(
+                        &removedBlobs[next->threadID.load()], __ATOMIC_ACQUIRE);
+                    if (head.load() == first) {  // Same context
+                        QUEUE_STAT(statHelpDeq);
+                        barrier(&next->threadID);
+                        other->blob = next;
+                        TRACE_STORE(&other->blob);
+                        barrierOpt(&other->blob);
+                        COUNT_CAS(statCasHead, head.compare_exchange_strong(first, next));
+                    }
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Releases the view that the last dequeue of the thread returned. The
+     * release is flushed without a fence, so it is durable by the next fence
+     * of the thread at the latest.
+     */
+    void release(int threadID = currentThreadID()) {
+        RemovedBlob* removed = removedBlobs[threadID];
+        if (removed != nullptr) {
+            removed->released = true;
+            TRACE_STORE(&removed->released);
+            barrierOpt(&removed->released);
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the blob that the thread dequeued last, if it did not release
+     * it before the crash, and an empty view otherwise. Valid after recover.
+     */
+    BlobView unreleased(int threadID) {
+        RemovedBlob* removed = removedBlobs[threadID];
+        if (removed == nullptr || removed->released) {
+            return BlobView();
+        }
+        return BlobView(removed->blob.load());
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Brings the queue back to a consistent state after a crash, like the
+     * Durable policy of PersistentQueue. Must run before any other operation.
+     * A dequeue that claimed a node but did not record it before the crash
+     * gets it in its entry of removedBlobs, so unreleased returns it.
+     */
+    void recover() {
+        // The nodes that were claimed after the head, and the last one that
+        // every thread claimed
+        std::vector<Blob*> lastClaims;
+        Blob* first = head.load();
+        Blob* next = first->next.load();
+        while (next != nullptr && next->threadID.load() != -1) {
+            size_t claimer = next->threadID.load();
+            if (claimer >= lastClaims.size()) {
+                lastClaims.resize(claimer + 1, nullptr);
+            }
+            lastClaims[claimer] = next;
+            first = next;
+            next = first->next.load();
+        }
+        // The claims of a thread follow the order of the queue, so its last
+        // claim is either that of its last dequeue or the node it removed
+        // before
+        for (size_t i = 0; i < lastClaims.size(); i++) {
+            if (lastClaims[i] == nullptr) {
+                continue;
+            }
+            RemovedBlob* removed = removedBlobs[i];
+            if (removed != nullptr && !removed->empty &&
+                removed->blob.load() == nullptr &&
+                removed->previous != lastClaims[i]) {
+                removed->blob = lastClaims[i];
+                barrier(&removed->blob);
+            }
+        }
+        head = first;
+        barrier(&head);
+        Blob* last = tail.load();
+        while (last->next.load() != nullptr) {
+            barrierOpt(&last->next);
+            last = last->next.load();
+        }
+        tail = last;
+        barrier(&tail);
+    }
+
+    //-------------------------------------------------------------------------
+
+    // Hot path counters. Empty unless compiled with -DQUEUE_STATS.
+    QueueStats stats;
+
+  private:
+
+    // The unit of the allocation of a node.
+    class alignas(CACHE_LINE) Line {
+        char bytes[CACHE_LINE];
+    };
+
+    std::atomic<Blob*> head;
+    int padding1[PADDING];
+    std::atomic<Blob*> tail;
+    int padding2[PADDING];
+
+    using Hooks::fence;
+    using Hooks::barrier;
+    using Hooks::barrierOpt;
+    using Hooks::barrierLines;
+
+    //-------------------------------------------------------------------------
+
+    /* Allocates a node for size bytes and writes the header and a copy of the
+     * bytes at data with streaming stores. A last partial word is padded with
+     * zeros, so no byte after the blob is read. If the Flush primitive tracks
+     * lines (Msync only persists the lines it was given), they are stored
+     * and every line of the node is flushed instead. Returns once the node is
+     * durable.
+     */
+    Blob* createBlob(const void* data, uint32_t size) {
+        size_t lines = (sizeof(Blob) + size + CACHE_LINE - 1) / CACHE_LINE;
+        Blob* node = (Blob*)allocNodes<Line>(lines);
+        if constexpr (Flush::tracksLines) {
+            new (node) Blob(size);
+            if (size != 0) {  // The dummy node has no data
+                std::memcpy((void*)(node + 1), data, size);
+            }
+#ifdef PERSIST_TRACE
+            TRACE_STORE_LINES(node, sizeof(Blob) + size, __FILE__, __LINE__);
+#endif
+            barrierLines(node, sizeof(Blob) + size);
+            return node;
+        }
+        Blob header(size);
+        STREAM_STORE(node, &header, sizeof(Blob));
+        char* body = (char*)(node + 1);
+        size_t whole = size - size % sizeof(long long);
+        STREAM_STORE(body, data, whole);
+        if (whole < size) {
+            long long last = 0;
+            std::memcpy(&last, (const char*)data + whole, size - whole);
+            STREAM_STORE(body + whole, &last, sizeof(long long));
+        }
+#ifdef PERSIST_TRACE
+        TRACE_STREAM_LINES(node, sizeof(Blob) + size, __FILE__, __LINE__);
+#endif
+        fence();  // Persist the header and the bytes before linking the node
+        return node;
+    }
+};
+//=============================End BlobQueue Class===========================//
+
+#endif /* BLOB_QUEUE_H_ */
@@ -0,0 +1,475 @@
+#ifndef COMPACT_QUEUE_H_
+#define COMPACT_QUEUE_H_
+
+#include <atomic>
+#include <new>
+#include <vector>
+#include <stdint.h>
+#include "PersistentQueue.h"
+
+//==========================Start CompactQueue Class=========================//
+/* The Durable queue with a compact node format. Every node and every saved
+ * dequeued value lives in a slot of a pool that directly follows the queue in
+ * memory, and is referenced by its 32-bit slot number instead of a pointer.
+ * The next pointers, the head and the tail are 64-bit words that hold a slot
+ * number and a tag, so they are CASed as one word. A tag grows by one with
+ * every change of its word, which keeps the CASes safe from ABA once slots
+ * are reused. Like the other queues, this version never reuses them.
+ * A node with an int value takes 16 bytes, so four share a cache line where
+ * a PersistentQueue node takes a whole line, and the queue holds no absolute
+ * address: a persistent image that is mapped at another address is recovered
+ * with reinterpret_cast<CompactQueue<T>*>(address)->recover().
+ * Slot 0 is never allocated and stands for null. A queue is created with
+ * create(), in nodeArena if one is set.
+ */
+template <class T, class Flush = Clflush> class CompactQueue
+    : protected PersistHooks<Flush> {
+
+    typedef PersistHooks<Flush> Hooks;
+
+  public:
+
+    //============================Start Node Class===========================//
+    /* Node is the type of the elements that will be in the queue.
+     * It contains the following fields:
+     * value    - can be of any type. It holds the data of the element.
+     * threadID - holds the id of the thread that manages to dequeue this
+     *            node, like the node of the Durable policy.
+     * next     - the slot of the next element in the queue and its tag.
+     */
+    class Node {
+      public:
+        T value;
+        std::atomic<int> threadID;
+        std::atomic<uint64_t> next;
+    };
+    //============================End Node Class=============================//
+
+    //=========================Start RemovedValue Class=======================//
+    /* The value that a thread saved in a dequeue. It contains the following
+     * fields:
+     * value    - the removed value, INT_MAX until the dequeue removes one and
+     *            INT_MIN if it found the queue empty.
+     * node     - the slot of the removed node, 0 until its taker records it.
+     * previous - the slot of the node that the thread removed before this
+     *            dequeue, or 0. Recovery tells by it whether the last node
+     *            the thread claimed was taken by this dequeue.
+     */
+    class RemovedValue {
+      public:
+        T value;
+        uint32_t node;
+        uint32_t previous;
+    };
+    //==========================End RemovedValue Class========================//
+
+    //=========================Start RemovedSlot Class========================//
+    /* The entry of a thread in removedValues: the slot of its last
+     * RemovedValue, or 0. Every entry takes a cache line of its own, like
+     * those of PerThread, which cannot be used here since its chunks are
+     * reached by address and the queue may be mapped at another one.
+     */
+    class alignas(CACHE_LINE) RemovedSlot {
+      public:
+        uint32_t slot;
+    };
+    //==========================End RemovedSlot Class=========================//
+
+    // The size of a slot. The smallest power of two that holds a node or a
+    // removed value, so a slot never crosses a cache line.
+    static constexpr size_t LARGEST = sizeof(Node) > sizeof(RemovedValue) ?
+                                      sizeof(Node) : sizeof(RemovedValue);
+    static constexpr size_t SLOT = LARGEST <= 16 ? 16 : LARGEST <= 32 ? 32 : 64;
+
+    static_assert(LARGEST <= CACHE_LINE,
+                  "A node must fit in one cache line");
+
+    // The number of slots whose allocation is persisted at once.
+    static const uint64_t RESERVE_SLOTS = 4096;
+
+    /* Creates a queue with room for the given number of slots. Every enq
+     * takes a slot and every deq that finds the queue non-empty takes
+     * another one.
+     */
+    static CompactQueue* create(uint64_t capacity) {
+        if (capacity >= ((uint64_t)1 << 32)) {
+            throw std::bad_alloc();
+        }
+        size_t size = header() + capacity * SLOT;
+        void* memory;
+        if (nodeArena) {
+            memory = nodeArena->allocate(size, CACHE_LINE);
+        } else if (posix_memalign(&memory, CACHE_LINE, size) != 0) {
+            throw std::bad_alloc();
+        }
+        return new (memory) CompactQueue(capacity);
+    }
+
+    //-------------------------------------------------------------------------
+
+    void initialize() {
+        std::vector<T> values(QUEUE_SIZE);
+        for (int i = 0; i < QUEUE_SIZE; i++){
+            values[i] = i+1;
+        }
+        bulkLoad(values.data(), QUEUE_SIZE);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Appends count nodes with the given values, in order, for filling the
+     * queue before it is shared: no other operation may run concurrently.
+     * Like PersistentQueue::bulkLoad, the nodes take consecutive slots and
+     * are written already linked with streaming stores, or, if the Flush
+     * primitive tracks lines, stored and flushed a line at a time. A single
+     * fence persists all of them before they are linked after the tail.
+     */
+    void bulkLoad(const T* values, uint32_t count) {
+        if (count == 0) {
+            return;
+        }
+        uint32_t first = allocate(count);
+        for (uint32_t i = 0; i < count; i++) {
+            Node staged;
+            staged.value = values[i];
+            staged.threadID.store(-1, std::memory_order_relaxed);
+            staged.next.store(pack(i + 1 < count ? first + i + 1 : 0, 0),
+                              std::memory_order_relaxed);
+            if constexpr (!Flush::tracksLines) {
+                STREAM_STORE(nodeAt(first + i), &staged, sizeof(Node));
+                TRACE_STREAM(nodeAt(first + i));
+            } else {
+                std::memcpy((void*)nodeAt(first + i), (const void*)&staged,
+                            sizeof(Node));
+                TRACE_STORE(nodeAt(first + i));
+            }
+        }
+        if constexpr (!Flush::tracksLines) {
+            fence();  // Persist the streamed nodes before linking them
+        } else {
+            barrierLines(nodeAt(first), (size_t)count * SLOT);
+        }
+        uint64_t last = tail.load();
+        Node* lastNode = nodeAt(slotOf(last));
+        lastNode->next = pack(first, tagOf(lastNode->next.load()) + 1);
+        tail = pack(first + count - 1, tagOf(last) + 1);
+        TRACE_STORE(&lastNode->next);
+        barrier(&lastNode->next);
+        barrier(&tail);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Enqueues a node to the queue with the given value. */
+    void enq(T value) {
+        TRACE_OP("CompactQueue::enq");
+        QUEUE_STAT(statOperations);
+        uint32_t slot = allocate();
+        Node* node = nodeAt(slot);
+        node->value = value;
+        node->threadID = -1;
+        node->next = pack(0, 0);
+        TRACE_STORE(node);
+        barrier(node);  // Flush the node's line before connecting it
+        while (true) {
+            QUEUE_STAT(statIterations);
+            uint64_t last = tail.load();
+            Node* lastNode = nodeAt(slotOf(last));
+            uint64_t next = lastNode->next.load();
+            if (last == tail.load()) {
+                if (slotOf(next) == 0) {
+                    // Try to insert.
+                    if (COUNT_CAS(statCasNext, lastNode->next.compare_exchange_strong(
+                                      next, pack(slot, tagOf(next) + 1)))) {
+                        TRACE_STORE(&lastNode->next);
+                        barrierOpt(&lastNode->next);
+                        COUNT_CAS(statCasTail, tail.compare_exchange_strong(
+                                      last, pack(slot, tagOf(last) + 1)));
+                        return;
+                    }
+                } else {
+                    // If next is a node, help in promoting the tail
+                    QUEUE_STAT(statHelpTail);
+                    barrierOpt(&lastNode->next);
+                    COUNT_CAS(statCasTail, tail.compare_exchange_strong(
+                                  last, pack(slotOf(next), tagOf(last) + 1)));
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Tries to dequeue a node. Returns the value of the removed node, or
+     * INT_MIN if the queue is empty. Once the queue is found non-empty, the
+     * dequeue takes a slot for its RemovedValue and publishes it in the
+     * thread's entry in removedValues. The node is then stamped with the
+     * threadID, and the value and the slot of the node are saved in that
+     * slot, by the dequeue or by a thread that helps it, like in the Durable
+     * policy of PersistentQueue. A dequeue that finds the queue empty first
+     * takes no slot and leaves the entry as it is. The entries are in the
+     * queue image, so a threadID of MAX_THREADS or more throws
+     * ThreadIDException.
+     */
+    T deq(int threadID = currentThreadID()) {
+        TRACE_OP("CompactQueue::deq");
+        QUEUE_STAT(statOperations);
+        if (threadID < 0 || threadID >= MAX_THREADS) {
+            throw ThreadIDException();
+        }
+        RemovedValue* removed = nullptr;
+        while (true) {
+            QUEUE_STAT(statIterations);
+            uint64_t first = head.load();
+            uint64_t last = tail.load();
+            Node* firstNode = nodeAt(slotOf(first));
+            uint64_t next = firstNode->next.load();
+            if (first == head.load()) {
+                if (slotOf(first) == slotOf(last)) {
+                    if (slotOf(next) == 0) {  // The queue is empty
+                        if (removed != nullptr) {
+                            removed->value = INT_MIN;
+                            TRACE_STORE(&removed->value);
+                            barrier(removed);
+                        }
+                        QUEUE_STAT(statEmpty);
+                        return INT_MIN;
+                    }
+                    // If next is a node, help promote the tail
+                    QUEUE_STAT(statHelpTail);
+                    barrierOpt(&firstNode->next);
+                    COUNT_CAS(statCasTail, tail.compare_exchange_strong(
+                                  last, pack(slotOf(next), tagOf(last) + 1)));
+                    continue;
+                }
+                if (removed == nullptr) {
+                    removed = publishRemoved(threadID);
+                    continue;  // The queue may have changed meanwhile
+                }
+                Node* nextNode = nodeAt(slotOf(next));
+                T value = nextNode->value;
+                // Mark the node as removed by changing the threadID field
+                int valid = -1;
+                if (COUNT_CAS(statCasClaim,
+                              nextNode->threadID.compare_exchange_strong(valid, threadID))) {
+                    TRACE_STORE(&nextNode->threadID);
+                    barrier(&nextNode->threadID);
+                    removed->value = value;
+                    removed->node = slotOf(next);
+                    TRACE_STORE(removed);
+                    barrierOpt(removed);
+                    COUNT_CAS(statCasHead, head.compare_exchange_strong(
+                                  first, pack(slotOf(next), tagOf(first) + 1)));
+                    return value;
+                } else {
+                    RemovedValue* other = removedAt(removedValues[valid].slot);
+                    if (head.load() == first) {  // Same context
+                        QUEUE_STAT(statHelpDeq);
+                        barrier(&nextNode->threadID);
+                        other->value = value;
+                        other->node = slotOf(next);
+                        TRACE_STORE(other);
+                        barrierOpt(other);
+                        COUNT_CAS(statCasHead, head.compare_exchange_strong(
+                                      first, pack(slotOf(next), tagOf(first) + 1)));
+                    }
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the value that the thread saved in its last dequeue that found
+     * the queue non-empty, or null if it never had one. A threadID of MAX_THREADS or more throws
+     * ThreadIDException.
+     */
+    T* removedValue(int threadID) {
+        if (threadID < 0 || threadID >= MAX_THREADS) {
+            throw ThreadIDException();
+        }
+        uint32_t slot = removedValues[threadID].slot;
+        return slot == 0 ? nullptr : &removedAt(slot)->value;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Brings the queue back to a consistent state after a crash, at the
+     * address it is mapped at now. Must run before any other operation. Moves
+     * the head past all the nodes that were marked as removed and the tail to
+     * the last linked node, and goes on allocating after the last slot whose
+     * allocation was persisted. A dequeue that crashed between its claim and
+     * its RemovedValue gets its node, as in PersistentQueue::recover.
+     */
+    void recover() {
+        // The last node that every thread claimed after the head
+        std::vector<uint32_t> lastClaims(MAX_THREADS, 0);
+        uint64_t first = head.load();
+        uint64_t next = nodeAt(slotOf(first))->next.load();
+        while (slotOf(next) != 0 &&
+               nodeAt(slotOf(next))->threadID.load() != -1) {
+            lastClaims[nodeAt(slotOf(next))->threadID.load()] = slotOf(next);
+            first = next;
+            next = nodeAt(slotOf(first))->next.load();
+        }
+        // The claims of a thread follow the order of the queue, so its last
+        // claim is either that of its last dequeue or the node it removed
+        // before
+        for (int i = 0; i < MAX_THREADS; i++) {
+            uint32_t slot = removedValues[i].slot;
+            if (lastClaims[i] == 0 || slot == 0) {
+                continue;
+            }
+            RemovedValue* removed = removedAt(slot);
+            if (removed->value == INT_MAX &&
+                removed->previous != lastClaims[i]) {
+                removed->value = nodeAt(lastClaims[i])->value;
+                removed->node = lastClaims[i];
+                barrier(removed);
+            }
+        }
+        head = pack(slotOf(first), tagOf(head.load()) + 1);
+        barrier(&head);
+        uint32_t last = slotOf(tail.load());
+        while (slotOf(nodeAt(last)->next.load()) != 0) {
+            barrierOpt(&nodeAt(last)->next);
+            last = slotOf(nodeAt(last)->next.load());
+        }
+        tail = pack(last, tagOf(tail.load()) + 1);
+        barrier(&tail);
+        // Every value of durableReserved was flushed in reserved first
+        durableReserved = reserved.load();
+        allocated = durableReserved.load();
+    }
+
+    //-------------------------------------------------------------------------
+
+    // Hot path counters. Empty unless compiled with -DQUEUE_STATS.
+    QueueStats stats;
+
+  private:
+
+    std::atomic<uint64_t> head;
+    int padding1[PADDING];
+    std::atomic<uint64_t> tail;
+    int padding2[PADDING];
+    // The next free slot, the end of the reservation, and the end of the
+    // reservation that is known to be persisted. Slots are only handed out
+    // below durableReserved, and recovery goes on from reserved.
+    std::atomic<uint64_t> allocated;
+    int padding3[PADDING];
+    std::atomic<uint64_t> reserved;
+    std::atomic<uint64_t> durableReserved;
+    uint64_t capacity;
+    // The slot of the RemovedValue of the last dequeue of every thread that
+    // found the queue non-empty.
+    RemovedSlot removedValues[MAX_THREADS];
+
+    using Hooks::fence;
+    using Hooks::barrier;
+    using Hooks::barrierOpt;
+    using Hooks::barrierLines;
+
+    /* Makes the head and tail point to a durable dummy node. */
+    CompactQueue(uint64_t c)
+        : allocated(1), reserved(1), durableReserved(1), capacity(c) {
+        for (int i = 0; i < MAX_THREADS; i++) {
+            removedValues[i].slot = 0;
+            barrierOpt(&removedValues[i].slot);
+        }
+        uint32_t slot = allocate();
+        Node* dummy = nodeAt(slot);
+        dummy->value = INT_MAX;
+        dummy->threadID = -1;
+        dummy->next = pack(0, 0);
+        barrier(dummy);  // Flush the dummy node before connecting it
+        head = tail = pack(slot, 0);
+        barrier(&head);
+        barrier(&tail);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* The size of the queue in front of its pool, in whole cache lines. */
+    static constexpr size_t header() {
+        return (sizeof(CompactQueue) + CACHE_LINE - 1) &
+               ~(size_t)(CACHE_LINE - 1);
+    }
+
+    static uint64_t pack(uint32_t slot, uint32_t tag) {
+        return ((uint64_t)tag << 32) | slot;
+    }
+
+    static uint32_t slotOf(uint64_t word) {
+        return (uint32_t)word;
+    }
+
+    static uint32_t tagOf(uint64_t word) {
+        return (uint32_t)(word >> 32);
+    }
+
+    Node* nodeAt(uint32_t slot) {
+        return (Node*)((char*)this + header() + (size_t)slot * SLOT);
+    }
+
+    RemovedValue* removedAt(uint32_t slot) {
+        return (RemovedValue*)nodeAt(slot);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Takes a slot for a new RemovedValue of the thread, persists it and
+     * publishes it in the thread's entry. Only the thread replaces its
+     * entry, and the node of its last RemovedValue is final.
+     */
+    RemovedValue* publishRemoved(int threadID) {
+        uint32_t slot = allocate();
+        RemovedValue* removed = removedAt(slot);
+        removed->value = INT_MAX;
+        removed->node = 0;
+        removed->previous = 0;
+        uint32_t lastSlot = removedValues[threadID].slot;
+        if (lastSlot != 0) {
+            RemovedValue* last = removedAt(lastSlot);
+            removed->previous = last->node != 0 ? last->node : last->previous;
+        }
+        TRACE_STORE(removed);
+        barrier(removed);
+        removedValues[threadID].slot = slot;
+        TRACE_STORE(&removedValues[threadID].slot);
+        barrier(&removedValues[threadID].slot);
+        return removed;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Allocates count consecutive slots and returns the first. The
+     * allocation is persisted RESERVE_SLOTS at a time: a thread whose slots
+     * go past the persisted reserve first moves the reserve and flushes it,
+     * so a recovered queue never hands out a slot that may be in use. A
+     * thread that finds the reserve moved by another one also flushes it
+     * before it uses its slots, since durableReserved only advances to a
+     * value of reserved that was flushed.
+     */
+    uint32_t allocate(uint64_t count = 1) {
+        uint64_t slot = allocated.fetch_add(count);
+        if (slot + count > capacity) {
+            throw std::bad_alloc();
+        }
+        while (slot + count > durableReserved.load()) {
+            uint64_t current = reserved.load();
+            while (slot + count > current) {
+                reserved.compare_exchange_strong(current, current + RESERVE_SLOTS);
+            }
+            TRACE_STORE(&reserved);
+            barrier(&reserved);
+            uint64_t durable = durableReserved.load();
+            while (durable < current &&
+                   !durableReserved.compare_exchange_weak(durable, current)) {}
+        }
+        return (uint32_t)slot;
+    }
+};
+//===========================End CompactQueue Class==========================//
+
+#endif /* COMPACT_QUEUE_H_ */
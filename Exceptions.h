@@ -15,5 +15,29 @@ class EmptyException : public exception
   }
 };
 
+class SegmentFileException : public exception
+{
+  public:
+  const char * what () const throw () {
+    return "Segment File Exception";
+  }
+};
+
+class MsyncException : public exception
+{
+  public:
+  const char * what () const throw () {
+    return "Msync Exception";
+  }
+};
+
+class ThreadIDException : public exception
+{
+  public:
+  const char * what () const throw () {
+    return "Thread ID Exception";
+  }
+};
+
 #endif /* EXCEPTIONS_H_ */
 
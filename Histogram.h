@@ -0,0 +1,131 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "Utilities.h"
+
+//=========================Start LatencyHistogram Class======================//
+/* A log-linear histogram of latencies measured in cycles. Values below
+ * SUB_BUCKETS are counted exactly. Every power of two above that is split
+ * into SUB_BUCKETS equal buckets, so a reported percentile is within ~3% of
+ * the measured value. Each thread records into its own histogram and the
+ * histograms are merged after the run. It contains the following fields:
+ * counts - the number of values that fell in every bucket.
+ * total  - the number of recorded values.
+ * max    - the biggest recorded value.
+ */
+class LatencyHistogram {
+  public:
+    static const int SUB_BUCKET_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    uint64_t counts[NUM_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+
+    LatencyHistogram() {
+        reset();
+    }
+
+    //-------------------------------------------------------------------------
+
+    void reset() {
+        memset(counts, 0, sizeof(counts));
+        total = 0;
+        max = 0;
+    }
+
+    //-------------------------------------------------------------------------
+
+    void record(uint64_t cycles) {
+        counts[bucketOf(cycles)]++;
+        total++;
+        if (cycles > max) {
+            max = cycles;
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    void merge(const LatencyHistogram& other) {
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        if (other.max > max) {
+            max = other.max;
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the smallest value such that the given fraction (0-1) of the
+     * recorded values are smaller or equal to it. Returns 0 if empty.
+     */
+    uint64_t percentile(double fraction) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(fraction * total);
+        if (rank >= total) {
+            return max;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen > rank) {
+                uint64_t value = upperBoundOf(i);
+                return value < max ? value : max;
+            }
+        }
+        return max;
+    }
+
+    //-------------------------------------------------------------------------
+
+  private:
+
+    static int bucketOf(uint64_t value) {
+        if (value < (uint64_t)SUB_BUCKETS) {
+            return (int)value;
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        int sub = (int)(value >> (exponent - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+    }
+
+    //-------------------------------------------------------------------------
+
+    static uint64_t upperBoundOf(int bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+        uint64_t sub = bucket % SUB_BUCKETS + SUB_BUCKETS;
+        int shift = exponent - SUB_BUCKET_BITS;
+        return ((sub + 1) << shift) - 1;
+    }
+};
+//==========================End LatencyHistogram Class=======================//
+
+/* Returns the number of time stamp counter cycles per nanosecond, measured
+ * against the monotonic clock over the given number of milliseconds.
+ */
+double cyclesPerNanosecond(int milliseconds = 100) {
+    struct timespec start, end, pause;
+    pause.tv_sec = milliseconds / 1000;
+    pause.tv_nsec = (milliseconds % 1000) * 1000000L;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned long long startCycles = RDTSC();
+    nanosleep(&pause, nullptr);
+    unsigned long long endCycles = RDTSC();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double nanoseconds = (end.tv_sec - start.tv_sec) * 1e9 +
+                         (end.tv_nsec - start.tv_nsec);
+    return (endCycles - startCycles) / nanoseconds;
+}
+
+#endif /* HISTOGRAM_H_ */
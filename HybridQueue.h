@@ -0,0 +1,389 @@
+#ifndef HYBRID_QUEUE_H_
+#define HYBRID_QUEUE_H_
+
+#include <atomic>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <functional>
+#include "PersistentQueue.h"
+
+//===========================Start HybridQueue Class=========================//
+/* A durable queue that keeps its linked list in DRAM and persists only a
+ * record per enqueue: the value and the stamp of its node. Every node holds
+ * the stamp of its predecessor plus one, like the tickets of the Buffered
+ * queue, so the stamps give the order of the queue. The records of a thread
+ * are written only by that thread, into chunks of its own persistent area,
+ * and a record is marked as linked once the CAS that linked its node
+ * succeeded. The next pointers, the head and the tail are never flushed.
+ * A dequeue persists, in the area of its thread, the stamp of the node it
+ * removed. The stamps are removed in order, so every record with a stamp up
+ * to the largest persisted one was dequeued.
+ * Recovery rebuilds the list from the linked records with larger stamps. The
+ * records of a thread are already sorted by their stamps, so the areas are
+ * scanned in parallel and their lists are merged. An enqueue that linked its
+ * node but did not mark its record has not completed, and its value may be
+ * left out, which leaves a gap in the stamps.
+ * The queue itself must be in persistent memory (nodeArena). Its nodes are
+ * always allocated on the heap. This version DOES NOT contain any memory
+ * management.
+ */
+template <class T, class Flush = Clflush> class HybridQueue
+    : protected PersistHooks<Flush> {
+
+    typedef PersistHooks<Flush> Hooks;
+
+    // The fields of a record, for sizing it.
+    struct RecordFields {
+        long stamp;
+        T value;
+        std::atomic<bool> linked;
+    };
+
+  public:
+
+    // The records of a thread are allocated CHUNK_RECORDS at a time.
+    static const int CHUNK_RECORDS = 4096;
+
+    // The smallest power of two that holds a record, so a record never
+    // crosses a cache line and is persisted with one flush.
+    static constexpr size_t RECORD_ALIGNMENT =
+        sizeof(RecordFields) <= 16 ? 16 :
+        sizeof(RecordFields) <= 32 ? 32 : CACHE_LINE;
+
+    static_assert(sizeof(RecordFields) <= CACHE_LINE,
+                  "A record must fit in one cache line");
+
+    //===========================Start Record Class==========================//
+    /* The persistent copy of an enqueued node. The stamp and the value are
+     * stored before linked, in the same line, so a linked record is always
+     * whole. It contains the following fields:
+     * stamp  - the stamp of the node.
+     * value  - the value of the node.
+     * linked - whether the node was linked into the queue.
+     */
+    class alignas(RECORD_ALIGNMENT) Record {
+      public:
+        long stamp;
+        T value;
+        std::atomic<bool> linked;
+        Record() : stamp(0), value(T()), linked(false) {}
+    };
+    //============================End Record Class===========================//
+
+    //============================Start Chunk Class==========================//
+    /* A block of records of one thread. The chunks of a thread are linked in
+     * the order they were allocated.
+     */
+    class alignas(CACHE_LINE) Chunk {
+      public:
+        Record records[CHUNK_RECORDS];
+        Chunk* next;
+    };
+    //============================End Chunk Class============================//
+
+    //============================Start Area Class===========================//
+    /* The persistent area of a thread. Takes a cache line of its own, so a
+     * dequeue persists it with one flush. It contains the following fields:
+     * removedStamp - (persistent) the largest stamp the thread knows to be
+     *                dequeued.
+     * removed      - (persistent) the record of the last node the thread
+     *                dequeued, or null.
+     * first        - (persistent) the first chunk of the thread.
+     * current      - the chunk the thread takes its records from.
+     * used         - the number of records taken from current.
+     */
+    class alignas(CACHE_LINE) Area {
+      public:
+        std::atomic<long> removedStamp;
+        Record* removed;
+        Chunk* first;
+        Chunk* current;
+        int used;
+        Area() : removedStamp(0), removed(nullptr), first(nullptr),
+                 current(nullptr), used(CHUNK_RECORDS) {}
+    };
+    //=============================End Area Class============================//
+
+    //============================Start Node Class===========================//
+    /* Node is the type of the elements of the list in DRAM.
+     * It contains the following fields:
+     * value  - can be of any type. It holds the data of the element.
+     * stamp  - the position of the node in the queue.
+     * record - the persistent record of the node.
+     * next   - a pointer to the next element in the queue.
+     */
+    class alignas(NODE_ALIGNMENT) Node {
+      public:
+        T value;
+        long stamp;
+        Record* record;
+        std::atomic<Node*> next;
+        Node(T val, long s, Record* r) :
+            value(val), stamp(s), record(r), next(nullptr) {}
+    };
+    //============================End Node Class=============================//
+
+    /* The constructor of the queue. Makes the head and tail point to a dummy
+     * node with stamp 0. The areas are persisted empty as their ids are
+     * first used.
+     */
+    HybridQueue() {
+        head = tail = new Node(INT_MAX, 0, nullptr);
+    }
+
+    //-------------------------------------------------------------------------
+
+    void initialize() {
+        for (int i = 0; i < QUEUE_SIZE; i++){
+            enq(i+1);
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Enqueues a node to the queue with the given value. The record of the
+     * node is written once the node is linked, and is persisted with one
+     * flush of a line of the thread.
+     */
+    void enq(T value, int threadID = currentThreadID()) {
+        TRACE_OP("HybridQueue::enq");
+        QUEUE_STAT(statOperations);
+        Record* record = nextRecord(threadID);
+        Node* node = new Node(value, 0, record);
+        while (true) {
+            QUEUE_STAT(statIterations);
+            Node* last = tail.load();
+            Node* next = last->next.load();
+            if (last == tail.load()) {
+                if (next == nullptr) {
+                    // The node is still private, so its stamp can be set
+                    // before it is linked after last
+                    node->stamp = last->stamp + 1;
+                    if (COUNT_CAS(statCasNext,
+                                  last->next.compare_exchange_strong(next, node))) {
+                        record->stamp = node->stamp;
+                        record->value = value;
+                        record->linked.store(true, std::memory_order_release);
+                        TRACE_STORE(record);
+                        barrier(record);
+                        COUNT_CAS(statCasTail,
+                                  tail.compare_exchange_strong(last, node));
+                        return;
+                    }
+                } else {
+                    // If next is a node, help in promoting the tail
+                    QUEUE_STAT(statHelpTail);
+                    COUNT_CAS(statCasTail, tail.compare_exchange_strong(last, next));
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Tries to dequeue a node. Returns the value of the removed node, or
+     * INT_MIN if the queue is empty. The stamp of the removed node is
+     * persisted in the area of the thread before it returns. An empty
+     * dequeue persists the stamp of the head, so the nodes that other
+     * threads removed before it stay removed.
+     */
+    T deq(int threadID = currentThreadID()) {
+        TRACE_OP("HybridQueue::deq");
+        QUEUE_STAT(statOperations);
+        Area& area = areas[threadID];
+        while (true) {
+            QUEUE_STAT(statIterations);
+            Node* first = head.load();
+            Node* last = tail.load();
+            Node* next = first->next.load();
+            if (first == head.load()) {
+                if (first == last) {
+                    if (next == nullptr) {  // The queue is empty
+                        if (first->stamp > area.removedStamp.load()) {
+                            area.removedStamp = first->stamp;
+                            TRACE_STORE(&area.removedStamp);
+                            barrier(&area.removedStamp);
+                        }
+                        QUEUE_STAT(statEmpty);
+                        return INT_MIN;
+                    }
+                    // If next is a node, help promote the tail
+                    QUEUE_STAT(statHelpTail);
+                    COUNT_CAS(statCasTail, tail.compare_exchange_strong(last, next));
+                    continue;
+                }
+                T value = next->value;
+                if (COUNT_CAS(statCasHead, head.compare_exchange_strong(first, next))) {
+                    area.removed = next->record;
+                    area.removedStamp = next->stamp;
+                    TRACE_STORE(&area);
+                    barrier(&area);  // Both fields share the line
+                    return value;
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the value that the thread removed in its last dequeue, or null
+     * if it never dequeued. Also null if the enqueue of the value did not
+     * mark its record before the crash.
+     */
+    T* removedValue(int threadID) {
+        Record* record = areas[threadID].removed;
+        if (record == nullptr || !record->linked.load() ||
+            record->stamp != areas[threadID].removedStamp.load()) {
+            return nullptr;
+        }
+        return &record->value;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Rebuilds the list in DRAM after a crash. Must run before any other
+     * operation. The areas of the threads are scanned by the given number of
+     * threads, at least one, and the sorted lists of their records are
+     * merged. Every thread goes on taking records after the last one it
+     * linked.
+     */
+    void recover(int workers = 1) {
+        workers = std::max(workers, 1);
+        long removedStamp = 0;
+        int ids = 0;  // One more than the largest id with an area
+        areas.forEach([&removedStamp, &ids](int id, Area& area) {
+            removedStamp = std::max(removedStamp, area.removedStamp.load());
+            ids = id + 1;
+        });
+        std::vector<std::vector<Record*> > lists(ids);
+        std::vector<std::thread> scanners;
+        for (int w = 1; w < workers; w++) {
+            scanners.push_back(std::thread([this, w, workers, ids, removedStamp, &lists]() {
+                for (int i = w; i < ids; i += workers) {
+                    scanArea(i, removedStamp, lists[i]);
+                }
+            }));
+        }
+        for (int i = 0; i < ids; i += workers) {
+            scanArea(i, removedStamp, lists[i]);
+        }
+        for (std::thread& scanner : scanners) {
+            scanner.join();
+        }
+
+        // Merge the lists by their stamps
+        typedef std::pair<long, int> Entry;  // The stamp and the list
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > heads;
+        std::vector<size_t> positions(ids, 0);
+        for (int i = 0; i < ids; i++) {
+            if (!lists[i].empty()) {
+                heads.push(Entry(lists[i][0]->stamp, i));
+            }
+        }
+        Node* dummy = new Node(INT_MAX, removedStamp, nullptr);
+        Node* last = dummy;
+        while (!heads.empty()) {
+            int i = heads.top().second;
+            heads.pop();
+            Record* record = lists[i][positions[i]++];
+            Node* node = new Node(record->value, record->stamp, record);
+            last->next.store(node, std::memory_order_relaxed);
+            last = node;
+            if (positions[i] < lists[i].size()) {
+                heads.push(Entry(lists[i][positions[i]]->stamp, i));
+            }
+        }
+        head = dummy;
+        tail = last;
+    }
+
+    //-------------------------------------------------------------------------
+
+    // Hot path counters. Empty unless compiled with -DQUEUE_STATS.
+    QueueStats stats;
+
+  private:
+
+    std::atomic<Node*> head;
+    int padding1[PADDING];
+    std::atomic<Node*> tail;
+    int padding2[PADDING];
+    // The area of every thread id, in the chunks of nodeArena
+    PerThread<Area, Flush> areas;
+
+    using Hooks::fence;
+    using Hooks::barrier;
+    using Hooks::barrierLines;
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the next record of the thread. A new chunk is made durable
+     * before it is linked, so its records are durably unlinked before any of
+     * them is used. The chunk is written with streaming stores and fenced,
+     * or, if the Flush primitive tracks lines (Msync only persists the lines
+     * it was given), stored and flushed.
+     */
+    Record* nextRecord(int threadID) {
+        Area& area = areas[threadID];
+        if (area.used == CHUNK_RECORDS) {
+            Chunk* chunk = allocNodes<Chunk>(1);
+            if constexpr (!Flush::tracksLines) {
+                Record blank;
+                for (int i = 0; i < CHUNK_RECORDS; i++) {
+                    STREAM_STORE(&chunk->records[i], &blank, sizeof(Record));
+                }
+                Chunk* none = nullptr;
+                STREAM_STORE(&chunk->next, &none, sizeof(Chunk*));
+                TRACE_STREAM(chunk);
+                fence();
+            } else {
+                new (chunk) Chunk();
+                TRACE_STORE(chunk);
+                barrierLines(chunk, sizeof(Chunk));
+            }
+            if (area.current == nullptr) {
+                area.first = chunk;
+                TRACE_STORE(&area.first);
+                barrier(&area.first);
+            } else {
+                area.current->next = chunk;
+                TRACE_STORE(&area.current->next);
+                barrier(&area.current->next);
+            }
+            area.current = chunk;
+            area.used = 0;
+        }
+        return &area.current->records[area.used++];
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Collects the linked records of the thread with stamps above
+     * removedStamp, in stamp order, and moves the thread's next record past
+     * the last linked one.
+     */
+    void scanArea(int threadID, long removedStamp, std::vector<Record*>& list) {
+        Area& area = areas[threadID];
+        Chunk* last = nullptr;
+        int used = 0;
+        for (Chunk* chunk = area.first; chunk != nullptr; chunk = chunk->next) {
+            last = chunk;
+            used = 0;
+            for (int i = 0; i < CHUNK_RECORDS; i++) {
+                Record* record = &chunk->records[i];
+                if (record->linked.load()) {
+                    used = i + 1;
+                    if (record->stamp > removedStamp) {
+                        list.push_back(record);
+                    }
+                }
+            }
+        }
+        area.current = last;
+        area.used = last == nullptr ? CHUNK_RECORDS : used;
+    }
+};
+//============================End HybridQueue Class==========================//
+
+#endif /* HYBRID_QUEUE_H_ */
@@ -0,0 +1,207 @@
+#ifndef MSYNC_FLUSH_H_
+#define MSYNC_FLUSH_H_
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "Exceptions.h"
+#include "Utilities.h"
+#include "NodeAllocator.h"
+
+//================================Start Msync================================//
+/* A flush primitive for hosts with only block storage, which makes the queues
+ * durable in a NodeArena that is mapped from a file on an SSD. flush records
+ * the page of the line in a list of the calling thread, and fence writes the
+ * pages back with the kernel. The fences are group-committed: a fence adds
+ * the pages of its thread to the next batch and waits until a batch with them
+ * is on disk. The first fence that finds no commit running becomes the leader
+ * of the batch. It waits for the batching window, so the fences of other
+ * threads can join, and then writes the batch with one msync if its pages
+ * are one contiguous run, or one fdatasync of the file otherwise. A longer
+ * window takes fewer syncs for more latency per fence. The pages of a private
+ * arena are written to its file with pwrite and synced with one fdatasync,
+ * so the file holds exactly the pages that were fenced: a test can map it
+ * again to see what a crash would leave.
+ * The order of the queues holds as with cache line flushes: a fence returns
+ * once the lines it covers are on disk, and the kernel may write back any
+ * other dirty page at any time, like a cache line may be evicted. Only lines
+ * in the attached arena are made durable, so the queue itself should be
+ * allocated there too (with allocNode). Select it as the Flush parameter of
+ * a PersistentQueue, and call attach before the queue is created.
+ * A fence whose batch fails to be written throws MsyncException. The pages
+ * of the failed batch go back to the pending pages, so the next fence writes
+ * them again, and the fences that waited for the batch keep waiting for it.
+ */
+struct Msync {
+    static constexpr bool streamsNodes = false;
+    static constexpr bool tracksLines = true;  // Only flushed pages are synced
+
+    /* Makes the fences write back the pages of the given arena, and waits
+     * windowMicros microseconds for more fences before every commit.
+     */
+    static void attach(NodeArena* arena, long windowMicros = 0) {
+        std::lock_guard<std::mutex> lock(state().mutex);
+        state().arena = arena;
+        state().windowMicros = windowMicros;
+    }
+
+    static void flush(const volatile void* p) {
+        CRASH_POINT();
+#ifdef COUNT_FLUSHES
+        flushCount++;
+#endif
+        NodeArena* arena = state().arena;
+        char* page = (char*)((size_t)p & ~(PAGE - 1));
+        if (arena == nullptr || page < arena->base ||
+            page >= arena->base + arena->size) {
+            return;
+        }
+        std::vector<char*>& dirty = dirtyPages();
+        if (dirty.empty() || dirty.back() != page) {
+            dirty.push_back(page);
+        }
+    }
+
+    static void fence() {
+        CRASH_POINT();
+        std::vector<char*>& dirty = dirtyPages();
+        if (dirty.empty()) {
+            return;
+        }
+        State& s = state();
+        std::unique_lock<std::mutex> lock(s.mutex);
+        if (s.arena == nullptr) {  // Flushed before the arena was detached
+            dirty.clear();
+            return;
+        }
+        s.pending.insert(s.pending.end(), dirty.begin(), dirty.end());
+        dirty.clear();
+        s.fences++;
+        long batch = s.nextBatch;
+        while (s.durableBatch < batch) {
+            if (s.committing) {
+                s.committed.wait(lock);
+            } else {
+                commit(lock);
+            }
+        }
+    }
+
+    /* The number of batches that were written. */
+    static long commits() {
+        std::lock_guard<std::mutex> lock(state().mutex);
+        return state().written;
+    }
+
+    /* The number of fences that waited for a batch. */
+    static long fences() {
+        std::lock_guard<std::mutex> lock(state().mutex);
+        return state().fences;
+    }
+
+  private:
+
+    static const size_t PAGE = 4096;
+
+    /* The group commit state of all the threads. It contains the following
+     * fields:
+     * pending      - the pages of the fences that wait for the next batch.
+     * nextBatch    - the number of the batch that pending goes into.
+     * durableBatch - the number of the last batch that is on disk.
+     * committing   - whether a leader is writing a batch.
+     * written      - the number of batches that were written, which is
+     *                durableBatch unless a batch failed.
+     * fences       - the number of fences that waited for a batch.
+     */
+    struct State {
+        std::mutex mutex;
+        std::condition_variable committed;
+        NodeArena* arena = nullptr;
+        long windowMicros = 0;
+        std::vector<char*> pending;
+        long nextBatch = 1;
+        long durableBatch = 0;
+        bool committing = false;
+        long written = 0;
+        long fences = 0;
+    };
+
+    static State& state() {
+        static State s;
+        return s;
+    }
+
+    static std::vector<char*>& dirtyPages() {
+        static thread_local std::vector<char*> dirty;
+        return dirty;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Writes the pending pages as the next batch. Called with the lock held,
+     * which it releases while it waits and writes. Throws MsyncException if
+     * a write or a sync fails, and then puts the pages back into pending and
+     * leaves durableBatch as it was.
+     */
+    static void commit(std::unique_lock<std::mutex>& lock) {
+        State& s = state();
+        s.committing = true;
+        if (s.windowMicros > 0) {
+            lock.unlock();
+            struct timespec window = {s.windowMicros / 1000000,
+                                      (s.windowMicros % 1000000) * 1000};
+            nanosleep(&window, nullptr);
+            lock.lock();
+        }
+        std::vector<char*> pages;
+        pages.swap(s.pending);
+        long batch = s.nextBatch++;
+        NodeArena* arena = s.arena;
+        lock.unlock();
+
+        std::sort(pages.begin(), pages.end());
+        pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+        bool contiguous = (size_t)(pages.back() - pages.front()) ==
+                          (pages.size() - 1) * PAGE;
+        bool failed = false;
+        if (arena->isPrivate && arena->fd >= 0) {
+            for (size_t i = 0; i < pages.size() && !failed; i++) {
+                failed = pwrite(arena->fd, pages[i], PAGE,
+                                pages[i] - arena->base) != (ssize_t)PAGE;
+            }
+            failed = failed || fdatasync(arena->fd) != 0;
+        } else if (contiguous || arena->fd < 0) {
+            for (size_t i = 0; i < pages.size() && !failed;) {
+                size_t run = 1;
+                while (i + run < pages.size() &&
+                       pages[i + run] == pages[i] + run * PAGE) {
+                    run++;
+                }
+                failed = msync(pages[i], run * PAGE, MS_SYNC) != 0;
+                i += run;
+            }
+        } else {
+            failed = fdatasync(arena->fd) != 0;
+        }
+
+        lock.lock();
+        if (failed) {
+            s.pending.insert(s.pending.end(), pages.begin(), pages.end());
+        } else {
+            s.durableBatch = batch;
+            s.written++;
+        }
+        s.committing = false;
+        s.committed.notify_all();
+        if (failed) {
+            throw MsyncException();
+        }
+    }
+};
+//=================================End Msync=================================//
+
+#endif /* MSYNC_FLUSH_H_ */
@@ -0,0 +1,315 @@
+#ifndef NODE_ALLOCATOR_H_
+#define NODE_ALLOCATOR_H_
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <new>
+#include <utility>
+#include "Utilities.h"
+
+//============================Start NodeArena Class==========================//
+/* A memory region that the nodes are allocated from instead of the heap. The
+ * region is a shared mapping, either anonymous or backed by a file, so it
+ * survives the process that allocated from it: a forked child can build a
+ * queue in the arena, and the parent can recover the queue after the child
+ * crashes. The first cache line of the region holds the number of bytes that
+ * were handed out, so every process that maps the region agrees on it. Every
+ * thread takes chunks of CHUNK_SIZE bytes and allocates from its chunk
+ * without synchronization. Memory is never freed.
+ * With HUGE_PAGES the region is backed by 2MB pages, so long walks over the
+ * nodes take a TLB miss per 2MB instead of per 4KB. The arena first asks for
+ * pages of the hugetlbfs pool with MAP_HUGETLB, and falls back to a region
+ * aligned to 2MB with madvise(MADV_HUGEPAGE), which lets the kernel back it
+ * with transparent huge pages if it allows them for the mapping (shared
+ * anonymous mappings follow shmem_enabled). pages tells which one was taken.
+ * With PRIVATE the mapping is private, for runs that do not fork.
+ * Every mapped arena is listed until it is unmapped, so owner() tells the
+ * arena an address belongs to. At most MAX_ARENAS arenas are mapped at once.
+ */
+class NodeArena {
+  public:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    static const int MAX_ARENAS = 64;
+
+    // The options of an arena.
+    static const int HUGE_PAGES = 1;
+    static const int PRIVATE = 2;
+
+    // The pages an arena is backed by.
+    enum Pages {smallPages, hugetlbPages, transparentPages};
+
+    /* Maps an arena of the given size. If a path is given, the arena is
+     * backed by that file, which is created or extended to the size. options
+     * is a combination of HUGE_PAGES and PRIVATE.
+     */
+    NodeArena(size_t size, const char* path = nullptr, int options = 0)
+        : size(size), pages(smallPages), fd(-1),
+          isPrivate(options & PRIVATE) {
+        int flags = (options & PRIVATE ? MAP_PRIVATE : MAP_SHARED) |
+                    MAP_NORESERVE;
+        if (options & HUGE_PAGES) {
+            // The file must cover the whole rounded mapping, or touching its
+            // tail raises SIGBUS
+            this->size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        }
+        if (path) {
+            fd = open(path, O_RDWR | O_CREAT, 0644);
+            if (fd < 0 || ftruncate(fd, this->size) != 0) {
+                throw std::bad_alloc();
+            }
+        } else {
+            flags |= MAP_ANONYMOUS;
+        }
+        void* region = MAP_FAILED;
+        if (options & HUGE_PAGES) {
+            if (!path) {
+                // Without MAP_NORESERVE the pages are reserved here, so a
+                // pool that is too small fails the mmap instead of the first
+                // touch of a page
+                region = mmap(nullptr, this->size, PROT_READ | PROT_WRITE,
+                              (flags & ~MAP_NORESERVE) | MAP_HUGETLB, -1, 0);
+                pages = hugetlbPages;
+            }
+            if (region == MAP_FAILED) {
+                region = mapAligned(this->size, flags, fd);
+                pages = transparentPages;
+            }
+        } else {
+            region = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags,
+                          fd, 0);
+        }
+        if (region == MAP_FAILED) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::bad_alloc();
+        }
+        base = (char*)region;
+        used = new (base) std::atomic<size_t>(CACHE_LINE);
+        for (int i = 0; ; i++) {
+            if (i == MAX_ARENAS) {
+                munmap(base, this->size);
+                if (fd >= 0) {
+                    close(fd);
+                }
+                throw std::bad_alloc();
+            }
+            NodeArena* none = nullptr;
+            if (arenas()[i].compare_exchange_strong(none, this)) {
+                break;
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    ~NodeArena() {
+        for (int i = 0; i < MAX_ARENAS; i++) {
+            NodeArena* self = this;
+            if (arenas()[i].compare_exchange_strong(self, nullptr)) {
+                break;
+            }
+        }
+        munmap(base, size);
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns memory of the given size and alignment from the chunk of the
+     * calling thread. Objects bigger than a chunk get memory of their own.
+     */
+    void* allocate(size_t bytes, size_t alignment) {
+        Chunk& chunk = threadChunk();
+        if (chunk.arena == this) {
+            char* start = (char*)(((size_t)chunk.current + alignment - 1) &
+                                  ~(alignment - 1));
+            if (start + bytes <= chunk.end) {
+                chunk.current = start + bytes;
+                return start;
+            }
+        }
+        if (bytes + alignment > CHUNK_SIZE) {
+            return reserve(bytes + alignment, alignment);
+        }
+        chunk.arena = this;
+        chunk.current = (char*)reserve(CHUNK_SIZE, CACHE_LINE);
+        chunk.end = chunk.current + CHUNK_SIZE;
+        return allocate(bytes, alignment);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Makes the calling thread take a new chunk on its next allocation.
+     * Must be called by a thread that forked, or that shares an arena with a
+     * process that forked it, before it allocates again.
+     */
+    static void forgetChunk() {
+        threadChunk().arena = nullptr;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Whether the given address is in the region of the arena. */
+    bool contains(const void* p) const {
+        return (const char*)p >= base && (const char*)p < base + size;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the mapped arena that contains the given address, or null if
+     * it is in none of them.
+     */
+    static NodeArena* owner(const void* p) {
+        for (int i = 0; i < MAX_ARENAS; i++) {
+            NodeArena* arena = arenas()[i].load(std::memory_order_acquire);
+            if (arena != nullptr && arena->contains(p)) {
+                return arena;
+            }
+        }
+        return nullptr;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* The number of bytes that were handed out to chunks. */
+    size_t usedBytes() {
+        return used->load();
+    }
+
+    //-------------------------------------------------------------------------
+
+    char* base;
+    size_t size;
+    Pages pages;
+    // The file the arena is mapped from, kept open for fdatasync, or -1.
+    int fd;
+    // Whether the mapping is private, so its writes never reach the file.
+    bool isPrivate;
+
+  private:
+
+    struct Chunk {
+        NodeArena* arena;
+        char* current;
+        char* end;
+    };
+
+    std::atomic<size_t>* used;
+
+    // The mapped arenas, in any order, with null for the free entries.
+    static std::atomic<NodeArena*>* arenas() {
+        static std::atomic<NodeArena*> mapped[MAX_ARENAS];
+        return mapped;
+    }
+
+    static Chunk& threadChunk() {
+        static thread_local Chunk chunk = {nullptr, nullptr, nullptr};
+        return chunk;
+    }
+
+    /* Maps a region that starts at a 2MB boundary and asks for transparent
+     * huge pages for it. A file is mapped as is, since its offset decides
+     * the alignment.
+     */
+    static void* mapAligned(size_t bytes, int flags, int fd) {
+        if (fd >= 0) {
+            void* region = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags,
+                                fd, 0);
+            if (region != MAP_FAILED) {
+                madvise(region, bytes, MADV_HUGEPAGE);
+            }
+            return region;
+        }
+        char* region = (char*)mmap(nullptr, bytes + HUGE_PAGE_SIZE,
+                                   PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (region == MAP_FAILED) {
+            return MAP_FAILED;
+        }
+        char* aligned = (char*)(((size_t)region + HUGE_PAGE_SIZE - 1) &
+                                ~(HUGE_PAGE_SIZE - 1));
+        if (aligned > region) {
+            munmap(region, aligned - region);
+        }
+        munmap(aligned + bytes, region + HUGE_PAGE_SIZE - aligned);
+        madvise(aligned, bytes, MADV_HUGEPAGE);
+        return aligned;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Hands out bytes from the region, starting at the given alignment.
+     * Every reservation is rounded up to whole cache lines, so the next one
+     * starts at a cache line and a chunk keeps all of its CHUNK_SIZE bytes.
+     */
+    void* reserve(size_t bytes, size_t alignment) {
+        bytes = (bytes + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+        size_t start = used->fetch_add(bytes);
+        if (start + bytes > size) {
+            throw std::bad_alloc();
+        }
+        char* memory = base + start;
+        return (char*)(((size_t)memory + alignment - 1) & ~(alignment - 1));
+    }
+};
+//=============================End NodeArena Class===========================//
+
+// The arena that allocNode allocates from. The heap is used if it is null.
+NodeArena* nodeArena = nullptr;
+
+//===========================Start NodeAllocator==============================//
+/* Allocates the nodes, logs and snapshots of all the queues. Every object
+ * starts at a NODE_ALIGNMENT boundary (or at its own alignment if it is
+ * bigger). With the default alignment of a cache line, an object that fits in
+ * a cache line is persisted by a single flush and never shares its line with
+ * a neighbour. The objects are taken from nodeArena if it is set. This
+ * version DOES NOT contain any memory management, like the queues that use
+ * it.
+ */
+template <class N, class... Args> N* allocNode(Args&&... args) {
+    size_t alignment = alignof(N) > NODE_ALIGNMENT ? alignof(N) : NODE_ALIGNMENT;
+    void* memory = nullptr;
+    if (nodeArena) {
+        memory = nodeArena->allocate(sizeof(N), alignment);
+    } else if (posix_memalign(&memory, alignment, sizeof(N)) != 0) {
+        throw std::bad_alloc();
+    }
+    return new (memory) N(std::forward<Args>(args)...);
+}
+
+/* Allocates memory for count consecutive objects of type N, without
+ * constructing them. Every object starts at a NODE_ALIGNMENT boundary if
+ * the size of N is a multiple of it, which holds for the aligned nodes.
+ */
+template <class N> N* allocNodes(size_t count) {
+    size_t alignment = alignof(N) > NODE_ALIGNMENT ? alignof(N) : NODE_ALIGNMENT;
+    void* memory = nullptr;
+    if (nodeArena) {
+        memory = nodeArena->allocate(sizeof(N) * count, alignment);
+    } else if (posix_memalign(&memory, alignment, sizeof(N) * count) != 0) {
+        throw std::bad_alloc();
+    }
+    return (N*)memory;
+}
+
+/* Frees an object that was allocated by allocNode. An object that is in a
+ * NodeArena is never freed one by one, since the arena is only unmapped as a
+ * whole. The arena is told by the address of the object rather than by
+ * nodeArena, which may have been set or reset since the object was
+ * allocated.
+ */
+template <class N> void freeNode(N* node) {
+    node->~N();
+    if (!NodeArena::owner(node)) {
+        free(node);
+    }
+}
+//============================End NodeAllocator==============================//
+
+#endif /* NODE_ALLOCATOR_H_ */
@@ -0,0 +1,160 @@
+#ifndef PERSIST_HOOKS_H_
+#define PERSIST_HOOKS_H_
+
+#include <cstring>
+#include "Utilities.h"
+
+//=============================Start Flush Primitives========================//
+/* The instructions a PersistentQueue writes back cache lines with. flush
+ * writes back one line, and fence waits until all the lines that the thread
+ * wrote back are durable. streamsNodes tells whether fresh nodes and log
+ * entries are written with streaming stores instead of being flushed.
+ * tracksLines tells whether only the lines that were given to flush become
+ * durable, so that lines written with streaming stores must still be flushed.
+ * Clflush    - clflush, which is ordered with other flushes. The default.
+ * Clflushopt - clflushopt, which is not ordered with other flushes.
+ * Clwb       - clwb, which also keeps the line in the cache.
+ * Streaming  - the flushes of Base, but the fresh nodes and log entries of
+ *              the Durable and Detectable policies are written with
+ *              STREAM_NODE and only fenced.
+ * Msync      - (MsyncFlush.h) pages of a file-backed NodeArena, written back
+ *              by group-committed msync or fdatasync, for hosts with only
+ *              SSDs.
+ * Transient  - nothing is written back, for volatile data. A PerThread with
+ *              it takes its chunks from the heap and is never traced.
+ */
+struct Clflush {
+    static constexpr bool streamsNodes = false;
+    static constexpr bool tracksLines = false;
+    static void flush(const volatile void* p) {
+        (FLUSH)((volatile void*)p);
+    }
+    static void fence() {
+        (SFENCE)();
+    }
+};
+
+struct Clflushopt {
+    static constexpr bool streamsNodes = false;
+    static constexpr bool tracksLines = false;
+    static void flush(const volatile void* p) {
+        FLUSHOPT((volatile void*)p);
+    }
+    static void fence() {
+        (SFENCE)();
+    }
+};
+
+struct Clwb {
+    static constexpr bool streamsNodes = false;
+    static constexpr bool tracksLines = false;
+    static void flush(const volatile void* p) {
+        CLWB((volatile void*)p);
+    }
+    static void fence() {
+        (SFENCE)();
+    }
+};
+template <class Base = Clflush> struct Streaming : Base {
+    static constexpr bool streamsNodes = true;
+};
+
+struct Transient {
+    static constexpr bool streamsNodes = false;
+    static constexpr bool tracksLines = false;
+    static void flush(const volatile void*) {}
+    static void fence() {}
+};
+//==============================End Flush Primitives=========================//
+
+//=============================Start PersistHooks Class======================//
+/* The persistence hooks of the persistent structures. They write back lines
+ * with the Flush primitive and, in a -DPERSIST_TRACE build, record the line of
+ * their caller like the FLUSH, SFENCE, BARRIER, BARRIER_OPT and BARRIER_NODE
+ * macros do.
+ */
+template <class Flush> class PersistHooks {
+  protected:
+
+    static void flush(const volatile void* p,
+                      [[maybe_unused]] const char* file = __builtin_FILE(),
+                      [[maybe_unused]] int line = __builtin_LINE()) {
+#ifdef PERSIST_TRACE
+        TRACE_EVENT(traceFlush, p, file, line);
+#endif
+        Flush::flush(p);
+    }
+
+    static void fence([[maybe_unused]] const char* file = __builtin_FILE(),
+                      [[maybe_unused]] int line = __builtin_LINE()) {
+#ifdef PERSIST_TRACE
+        TRACE_EVENT(traceFence, nullptr, file, line);
+#endif
+        Flush::fence();
+    }
+
+    static void barrier(const volatile void* p,
+                        const char* file = __builtin_FILE(),
+                        int line = __builtin_LINE()) {
+        flush(p, file, line);
+        fence(file, line);
+    }
+
+    static void barrierOpt(const volatile void* p,
+                           const char* file = __builtin_FILE(),
+                           int line = __builtin_LINE()) {
+        flush(p, file, line);
+    }
+
+    /* Flushes all the cache lines of the given node and fences. */
+    template <class N> static void barrierNode(N* node,
+                                               const char* file = __builtin_FILE(),
+                                               int line = __builtin_LINE()) {
+        if (alignof(N) >= CACHE_LINE && sizeof(N) <= CACHE_LINE) {
+            barrier(node, file, line);
+            return;
+        }
+        char* address = (char*)((size_t)node & ~(size_t)(CACHE_LINE - 1));
+        for (; address < (char*)node + sizeof(N); address += CACHE_LINE) {
+            flush(address, file, line);
+        }
+        fence(file, line);
+    }
+
+    /* Flushes all the cache lines of the given range and fences. */
+    static void barrierLines(const volatile void* p, size_t size,
+                             const char* file = __builtin_FILE(),
+                             int line = __builtin_LINE()) {
+        char* address = (char*)((size_t)p & ~(size_t)(CACHE_LINE - 1));
+        for (; address < (char*)p + size; address += CACHE_LINE) {
+            flush(address, file, line);
+        }
+        fence(file, line);
+    }
+
+    /* Gives a node that no other thread can reach yet the contents of staged
+     * and makes it durable, like storing them and calling barrierNode. Flush
+     * primitives that stream nodes write it with STREAM_NODE instead, so its
+     * lines are neither read for ownership nor flushed.
+     */
+    template <class N> static void persistNode(N* node, const N& staged,
+                                               const char* file = __builtin_FILE(),
+                                               int line = __builtin_LINE()) {
+        if constexpr (Flush::streamsNodes) {
+#ifdef PERSIST_TRACE
+            TRACE_STREAM_LINES(node, sizeof(N), file, line);
+            TRACE_EVENT(traceFence, nullptr, file, line);
+#endif
+            STREAM_NODE(node, &staged);
+        } else {
+            std::memcpy((void*)node, (const void*)&staged, sizeof(N));
+#ifdef PERSIST_TRACE
+            TRACE_STORE_LINES(node, sizeof(N), file, line);
+#endif
+            barrierNode(node, file, line);
+        }
+    }
+};
+//==============================End PersistHooks Class=======================//
+
+#endif /* PERSIST_HOOKS_H_ */
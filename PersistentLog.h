@@ -0,0 +1,363 @@
+#ifndef PERSISTENT_LOG_H_
+#define PERSISTENT_LOG_H_
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <sched.h>
+#include "PersistentQueue.h"
+
+//==========================Start PersistentLog Class========================//
+/* A persistent append-only log that is read by many consumers. The appended
+ * nodes form the chain of the Durable queue, and nothing is removed by a read:
+ * every registered consumer keeps its own cursor, the last node it read, so
+ * one durable append replaces an enqueue into a queue per consumer. A consumer
+ * reads a batch of values and then commits its cursor with a single flush. The
+ * nodes are freed a segment, SEGMENT_SIZE consecutive nodes, at a time, and
+ * only once all the committed cursors have passed them. The head is always a
+ * node that no consumer reads, the dummy or the last node of the last freed
+ * segment, so the oldest value that was not freed follows it.
+ * Every node holds its offset in the log, like the tickets of the Buffered
+ * queue: the dummy node holds 0 and every node holds the offset of its
+ * predecessor plus one. An offset is flushed with its node before the node is
+ * linked, so a cursor is persisted as a single pointer.
+ * An appender publishes the tail it works on in its entry of hazards, so the
+ * segment it is in is not freed under it. The entry is that of its thread id,
+ * which defaults to currentThreadID. A thread id and a consumer id must each
+ * be used by one thread at a time.
+ */
+template <class T, class Flush = Clflush> class PersistentLog
+    : protected PersistHooks<Flush> {
+
+    typedef PersistHooks<Flush> Hooks;
+
+  public:
+
+    static const int MAX_CONSUMERS = 64;
+    static const long SEGMENT_SIZE = 4096;
+
+    //============================Start Node Class===========================//
+    /* Node is the type of the elements that will be in the log.
+     * It contains the following fields:
+     * value  - can be of any type. It holds the data of the element.
+     * next   - a pointer to the next element in the log.
+     * offset - the position of the node in the log.
+     */
+    class alignas(NODE_ALIGNMENT) Node {
+      public:
+        T value;
+        std::atomic<Node*> next;
+        long offset;
+        Node(T val) : value(val), next(nullptr), offset(0) {}
+    };
+    //============================End Node Class=============================//
+
+    static_assert(sizeof(Node) <= CACHE_LINE,
+                  "A node must fit in one cache line");
+
+    //===========================Start Cursor Class==========================//
+    /* The state of a registered consumer. Takes a cache line of its own, so a
+     * commit persists it with one flush. It contains the following fields:
+     * committed - (persistent) the last node the consumer committed. After a
+     *             crash, the consumer goes on reading from its successor.
+     * active    - (persistent) whether the entry belongs to a consumer.
+     * position  - the last node the consumer read. Moves to committed on
+     *             commit, and back to it on recovery.
+     */
+    class alignas(CACHE_LINE) Cursor {
+      public:
+        std::atomic<Node*> committed;
+        std::atomic<bool> active;
+        Node* position;
+        Cursor() : committed(nullptr), active(false), position(nullptr) {}
+    };
+    //===========================End Cursor Class============================//
+
+    /* The constructor of the log. Makes the head and tail point to a durable
+     * dummy node with offset 0.
+     */
+    PersistentLog() {
+        Node* dummy = allocNode<Node>(T());
+        barrierNode(dummy);  // Flush the dummy node before connecting it
+        head = tail = dummy;
+        barrier(&head);
+        barrier(&tail);
+        for (int i = 0; i < MAX_CONSUMERS; i++) {
+            barrier(&cursors[i]);
+        }
+        registryLock = false;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Appends a node with the given value and returns its offset. The node is
+     * durable before it is linked, and its link before the tail passes it.
+     */
+    long append(T value, int threadID = currentThreadID()) {
+        TRACE_OP("PersistentLog::append");
+        Node* node = allocNode<Node>(value);
+        while (true) {
+            Node* last = protectTail(threadID);
+            Node* next = last->next.load();
+            if (next == nullptr) {
+                // The node is still private. Its offset is only flushed again
+                // when another node was appended after last in the meantime
+                if (node->offset != last->offset + 1) {
+                    node->offset = last->offset + 1;
+                    TRACE_STORE(node);
+                    barrierNode(node);
+                }
+                long offset = node->offset;
+                if (last->next.compare_exchange_strong(next, node)) {
+                    TRACE_STORE(&last->next);
+                    barrierOpt(&last->next);
+                    tail.compare_exchange_strong(last, node);
+                    // Once linked, the node may be read and freed
+                    hazards[threadID].store(nullptr);
+                    return offset;
+                }
+            } else {
+                // Help promoting the tail once the link is flushed
+                barrierOpt(&last->next);
+                tail.compare_exchange_strong(last, next);
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Registers a consumer and returns its id, or -1 if there are already
+     * MAX_CONSUMERS. The consumer reads from the oldest value that was not
+     * freed, the one after the head, if fromStart is true, and from the tail
+     * otherwise.
+     */
+    int registerConsumer(bool fromStart = true) {
+        lockRegistry();
+        int consumer = -1;
+        for (int i = 0; i < MAX_CONSUMERS; i++) {
+            if (!cursors[i].active.load()) {
+                consumer = i;
+                break;
+            }
+        }
+        if (consumer != -1) {
+            Cursor& cursor = cursors[consumer];
+            cursor.position = fromStart ? head.load() : tail.load();
+            cursor.committed = cursor.position;
+            cursor.active = true;
+            TRACE_STORE(&cursor);
+            barrier(&cursor);  // The cursor and its flag share the line
+        }
+        registryLock.store(false);
+        return consumer;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Removes the consumer, so its cursor no longer holds back the freeing
+     * of segments.
+     */
+    void unregisterConsumer(int consumer) {
+        lockRegistry();
+        cursors[consumer].active = false;
+        TRACE_STORE(&cursors[consumer].active);
+        barrier(&cursors[consumer].active);
+        registryLock.store(false);
+        reclaim();
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Reads up to max values that follow the position of the consumer into
+     * values, and moves the position past them. Returns the number of values
+     * that were read. Nothing is flushed unless the consumer reaches the
+     * tail, and then only the link of an appender that is still in progress.
+     */
+    int read(int consumer, T* values, int max) {
+        TRACE_OP("PersistentLog::read");
+        Node* position = cursors[consumer].position;
+        int count = 0;
+        while (count < max) {
+            Node* next = position->next.load();
+            if (next == nullptr) {
+                break;
+            }
+            Node* last = tail.load();
+            if (last == position) {
+                // The link may not be flushed yet, so a commit past it would
+                // not survive a crash. Help the appender first
+                barrierOpt(&last->next);
+                tail.compare_exchange_strong(last, next);
+            }
+            values[count++] = next->value;
+            position = next;
+        }
+        cursors[consumer].position = position;
+        return count;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Makes the position of the consumer its durable cursor, with one flush.
+     * Frees the segments that all the consumers have passed when the cursor
+     * enters a new segment.
+     */
+    void commit(int consumer) {
+        TRACE_OP("PersistentLog::commit");
+        Cursor& cursor = cursors[consumer];
+        Node* previous = cursor.committed.load();
+        Node* position = cursor.position;
+        if (position == previous) {
+            return;
+        }
+        cursor.committed.store(position);
+        TRACE_STORE(&cursor.committed);
+        barrier(&cursor.committed);
+        if (position->offset / SEGMENT_SIZE != previous->offset / SEGMENT_SIZE) {
+            reclaim();
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the offset of the last node the consumer committed. */
+    long committedOffset(int consumer) {
+        return cursors[consumer].committed.load()->offset;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Brings the log back to a consistent state after a crash. Must run
+     * before any other operation. Moves the tail to the last linked node and
+     * every consumer back to its committed cursor, so the values it read
+     * and did not commit are read again.
+     */
+    void recover() {
+        Node* last = tail.load();
+        while (last->next.load() != nullptr) {
+            barrierOpt(&last->next);
+            last = last->next.load();
+        }
+        tail = last;
+        barrier(&tail);
+        for (int i = 0; i < MAX_CONSUMERS; i++) {
+            if (cursors[i].active.load()) {
+                cursors[i].position = cursors[i].committed.load();
+            }
+        }
+        hazards.forEach([](int, std::atomic<Node*>& hazard) {
+            hazard.store(nullptr);
+        });
+        registryLock = false;
+    }
+
+  private:
+
+    // The node before the oldest value that was not freed
+    std::atomic<Node*> head;
+    int padding1[PADDING];
+    std::atomic<Node*> tail;
+    int padding2[PADDING];
+    Cursor cursors[MAX_CONSUMERS];
+    // The tail every appender works on, or null, by thread id
+    PerThread<std::atomic<Node*>, Flush> hazards;
+    // Taken by the registration of consumers and by reclaim
+    std::atomic<bool> registryLock;
+
+    using Hooks::barrier;
+    using Hooks::barrierOpt;
+    using Hooks::barrierNode;
+
+    //-------------------------------------------------------------------------
+
+    /* Reads the tail and publishes it in the hazards entry of the thread.
+     * Once the tail is read again after the publication, the node is not
+     * freed until the entry changes.
+     */
+    Node* protectTail(int threadID) {
+        while (true) {
+            Node* last = tail.load();
+            hazards[threadID].store(last);
+            if (tail.load() == last) {
+                return last;
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    void lockRegistry() {
+        bool unlocked = false;
+        while (!registryLock.compare_exchange_weak(unlocked, true)) {
+            unlocked = false;
+            sched_yield();
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Frees every whole segment behind the committed cursors, the tail and
+     * the nodes appenders work on. A segment holds the offsets from a
+     * multiple of SEGMENT_SIZE on, and its last node is kept as the new head,
+     * since a consumer that registers from the start reads after the head.
+     * The old head and the rest of the segment are freed. The head is
+     * persisted before the nodes are freed, so a crash never leaves it on a
+     * freed node.
+     * Gives up if another thread is already reclaiming or registering.
+     */
+    void reclaim() {
+        bool unlocked = false;
+        if (!registryLock.compare_exchange_strong(unlocked, true)) {
+            return;
+        }
+        // Only this thread frees nodes, so the tail it reads stays valid.
+        // An appender that published a tail after this read works on this
+        // tail or a later one
+        long bound = tail.load()->offset;
+        for (int i = 0; i < MAX_CONSUMERS; i++) {
+            if (cursors[i].active.load()) {
+                bound = std::min(bound, cursors[i].committed.load()->offset);
+            }
+        }
+        // A published tail may already be freed by an earlier reclaim if its
+        // appender did not validate it yet, so it is only compared with
+        std::vector<Node*> protectedNodes;
+        hazards.forEach([&protectedNodes](int, std::atomic<Node*>& hazard) {
+            Node* node = hazard.load();
+            if (node != nullptr) {
+                protectedNodes.push_back(node);
+            }
+        });
+        std::sort(protectedNodes.begin(), protectedNodes.end());
+        Node* first = head.load();
+        while (true) {
+            // The offset of the last node of the segment after the head
+            long lastOffset = ((first->offset + 1) / SEGMENT_SIZE + 1) *
+                              SEGMENT_SIZE - 1;
+            if (lastOffset > bound) {
+                break;
+            }
+            Node* last = first;
+            while (last->offset < lastOffset &&
+                   !std::binary_search(protectedNodes.begin(),
+                                       protectedNodes.end(), last)) {
+                last = last->next.load();
+            }
+            if (last->offset < lastOffset) {
+                break;
+            }
+            head = last;
+            TRACE_STORE(&head);
+            barrier(&head);
+            while (first != last) {
+                Node* next = first->next.load();
+                freeNode(first);
+                first = next;
+            }
+        }
+        registryLock.store(false);
+    }
+};
+//===========================End PersistentLog Class=========================//
+
+#endif /* PERSISTENT_LOG_H_ */
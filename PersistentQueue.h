@@ -0,0 +1,1627 @@
+#ifndef PERSISTENT_QUEUE_H_
+#define PERSISTENT_QUEUE_H_
+
+#include <atomic>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include <sched.h>
+#include "Utilities.h"
+#include "NodeAllocator.h"
+#include "PersistHooks.h"
+#include "QueueStats.h"
+#include "ThreadRegistry.h"
+#include "SegmentFile.h"
+
+//===========================Start Persistence Policies======================//
+/* The persistence guarantees a PersistentQueue can give. Each one is a tag
+ * that selects, at compile time, which flushes are issued and which fields the
+ * nodes and the queue carry. Fields and flushes of the other policies do not
+ * exist in the compiled queue.
+ * Volatile   - Michael and Scott's queue. Nothing is flushed.
+ * Durable    - durable linearizability. Every node is claimed by the id of
+ *              the dequeuing thread, and the dequeued node is saved in the
+ *              removedValues array of the thread.
+ * Detectable - durable linearizability and detectable execution. Every
+ *              operation is logged with its operation number in the logs
+ *              array, so recovery can tell whether it took effect.
+ * Buffered   - buffered durable linearizability. Nothing is flushed by enq
+ *              and deq. sync() makes a consistent snapshot of the queue
+ *              durable, and every node holds a ticket that tells whether it is
+ *              covered by the last snapshot.
+ */
+struct Volatile {};
+struct Durable {};
+struct Detectable {};
+struct Buffered {};
+//============================End Persistence Policies=======================//
+
+//===========================Start Cardinality Policies======================//
+/* How many threads may enqueue and dequeue concurrently. A single producer
+ * links its nodes with plain release stores and is the only thread that moves
+ * the tail, and a single consumer claims nodes and moves the head with plain
+ * stores, so the other side of the queue is the only one that CASes. The
+ * persistence of every policy stays the same. The Buffered policy keeps the
+ * CAS on the next pointer of the last node even with a single producer,
+ * because sync() blocks the tail by linking an Invalid node to it.
+ * MPMC - any number of producers and consumers. The default.
+ * MPSC - any number of producers and a single consumer.
+ * SPMC - a single producer and any number of consumers.
+ * SPSC - a single producer and a single consumer.
+ * Single means at most one thread at a time. The role can move to another
+ * thread only through a synchronization that orders the two threads.
+ */
+struct MPMC {
+    static constexpr bool singleProducer = false;
+    static constexpr bool singleConsumer = false;
+};
+
+struct MPSC {
+    static constexpr bool singleProducer = false;
+    static constexpr bool singleConsumer = true;
+};
+
+struct SPMC {
+    static constexpr bool singleProducer = true;
+    static constexpr bool singleConsumer = false;
+};
+
+struct SPSC {
+    static constexpr bool singleProducer = true;
+    static constexpr bool singleConsumer = true;
+};
+//============================End Cardinality Policies=======================//
+
+//===========================Start NodeState Class===========================//
+/* The fields a node carries for its persistence policy, next to its value and
+ * next pointer. The volatile node has none.
+ * threadID - (Durable) holds the id of the thread that manages to dequeue
+ *            this node. Helps for saving the returned value before a crash.
+ * logDeq   - (Detectable) a pointer to the LogEntry of the removal of the
+ *            node (if exists).
+ * logEnq   - (Detectable) the LogEntry of the insertion of the node. The node
+ *            and the log of its insertion are always created and read
+ *            together, so they share the node's cache line.
+ * ticket   - (Buffered) the position of the node in the queue. The dummy
+ *            node holds 0 and every node holds the ticket of its predecessor
+ *            plus one. It is written before the node is linked, so it is
+ *            persisted together with the node by makeDurble. The Invalid
+ *            blocks of sync() hold -1.
+ */
+template <class Policy, class Log> class NodeState {};
+
+template <class Log> class NodeState<Durable, Log> {
+  public:
+    std::atomic<int> threadID;
+    NodeState() : threadID(-1) {}
+};
+
+template <class Log> class NodeState<Detectable, Log> {
+  public:
+    std::atomic<Log*> logDeq;
+    Log logEnq;
+    NodeState() : logDeq(nullptr), logEnq() {}
+};
+
+template <class Log> class NodeState<Buffered, Log> {
+  public:
+    long ticket;
+    NodeState() : ticket(0) {}
+};
+//============================End NodeState Class============================//
+
+//=========================Start PersistentQueue Class=======================//
+/* Michael and Scott's queue with the persistence of one of the policies above,
+ * the flush primitive Flush and the number of producers and consumers of
+ * Cardinality. MSQueue, DurableQueue, LogQueue and
+ * RelaxedQueue are this queue with the Volatile, Durable, Detectable and
+ * Buffered policies. Every hook of a policy is selected with if constexpr, so
+ * each of them compiles to the same loop as a queue written for that policy
+ * alone. This version DOES NOT contain any memory management.
+ * The operations take a thread id and an operation number. The thread id is
+ * used by the Durable and Detectable policies, and the operation number only
+ * by the Detectable policy. The others ignore them. The thread id defaults to
+ * the one currentThreadID registered for the calling thread.
+ * T can be any default constructible type. emplace constructs the value in
+ * its node and try_deq tells an empty queue apart with an empty optional, so
+ * no value is reserved as a sentinel. enq and deq, which return INT_MIN for
+ * an empty queue, are kept for the int queues. A trivially copyable value is
+ * staged and written to its node in one piece, like the rest of the node.
+ * Any other value is constructed in the node itself.
+ */
+template <class T, class Policy, class Flush = Clflush,
+          class Cardinality = MPMC> class PersistentQueue
+    : protected PersistHooks<Flush> {
+
+    typedef PersistHooks<Flush> Hooks;
+
+    static constexpr bool durable = std::is_same<Policy, Durable>::value;
+    static constexpr bool detectable = std::is_same<Policy, Detectable>::value;
+    static constexpr bool buffered = std::is_same<Policy, Buffered>::value;
+    // Whether enq and deq flush. The buffered queue only flushes in sync().
+    static constexpr bool eager = durable || detectable;
+    // Whether enq links with a plain store and only the producer moves the
+    // tail.
+    static constexpr bool plainEnq = Cardinality::singleProducer && !buffered;
+    // Whether deq claims and moves the head with plain stores.
+    static constexpr bool plainDeq = Cardinality::singleConsumer;
+    // The ordering of the CASes that move the head and the tail. Buffered
+    // keeps them sequentially consistent, since sync() blocks the tail and
+    // then reads the head, and must not see an older head than the dequeues.
+    static constexpr std::memory_order moveOrder =
+        buffered ? std::memory_order_seq_cst : std::memory_order_release;
+    // Whether a node can be staged and copied to its place byte by byte.
+    static constexpr bool trivialValue = std::is_trivially_copyable<T>::value;
+
+    struct NoArray {};
+
+    // A per-thread array that only exists under some policies.
+    template <bool Exists, class E> using PolicyArray =
+        typename std::conditional<Exists, PerThread<E, Flush>, NoArray>::type;
+
+  public:
+
+    class Node;
+
+    // Indicated which operation the user is trying to execute.
+    enum Action {none, insert, remove, move};
+
+    //=========================Start LogEntry Class==========================//
+    /* LogEntry is the type of the elements that will be in the logs array of
+     * the Detectable policy. This entry represents an operation. It contains
+     * the following fields:
+     * operationNum - The number of the operation that is given by the user.
+     * 		      Helps to track which operations were executed.
+     * action       - The operation that was asked by the user - insert/remove.
+     * status       - updated ONLY if the queue is empty and the thread wants
+     * 		      to remove a node from an empty queue. Updated a moment
+     * 		      before the thread returns.
+     * node         - a pointer to the inserted node, or to the removed node
+     * 		      once the removal is done.
+     * threadID     - the thread that asked for the operation. Fits in the
+     * 		      padding before node, so the entry does not grow.
+     * source       - for a move, the node removed from the source queue once
+     * 		      the removal is done. node is then the node inserted into
+     * 		      the destination, and the entry is its logEnq.
+     */
+    class LogEntry {
+      public:
+	int operationNum;
+	Action action;
+	bool status;
+	int threadID;
+        Node* node;
+        Node* source;
+	LogEntry(): operationNum(-1), action(none), status(false),
+		    threadID(-1), node(NULL), source(NULL) {}
+	LogEntry(bool s, Node* n, Action a, int operationNumber, int tid):
+		operationNum(operationNumber), action(a), status(s),
+		threadID(tid), node(n), source(NULL) {}
+    };
+    //==========================End LogEntry Class===========================//
+
+    //============================Start Node Class===========================//
+    /* Node is the type of the elements that will be in the queue.
+     * It contains the following fields, and the fields of NodeState:
+     * value     - can be of any type. It holds the data of the element.
+     * next      - a pointer to the next element in the queue.
+     * Each node is aligned to its own cache line, so one flush persists it
+     * if its value is small. A larger value takes a flush per line.
+     */
+    class alignas(NODE_ALIGNMENT) Node : public NodeState<Policy, LogEntry> {
+      public:
+	T value;
+        std::atomic<Node*> next;
+        Node(T val) : value(std::move(val)), next(nullptr) {}
+        Node() : value(T()), next(nullptr) {}
+        template <class... Args> Node(std::in_place_t, Args&&... args)
+            : value(std::forward<Args>(args)...), next(nullptr) {}
+    };
+    //============================End Node Class=============================//
+
+    //========================Start RemovedValue Class=======================//
+    /* The entry of the removedValues array of the Durable policy for one
+     * dequeue. A new one is allocated for every dequeue, so a late helper
+     * can only write the entry of the dequeue it helped. It contains the
+     * following fields:
+     * node  - the removed node, which keeps its value since nodes are never
+     *         freed. Null until the dequeue takes a node. The taker and its
+     *         helpers all store the same node, so no value is copied.
+     * empty    - set if the dequeue found the queue empty.
+     * previous - the node that the thread removed before this dequeue, or
+     *            null. Recovery tells by it whether the last node the thread
+     *            claimed was taken by this dequeue.
+     */
+    class RemovedValue {
+      public:
+        std::atomic<Node*> node;
+        bool empty;
+        Node* previous;
+        RemovedValue() : node(nullptr), empty(false), previous(nullptr) {}
+    };
+    //=========================End RemovedValue Class========================//
+
+    //=========================Start LastNVMData Class=======================//
+    /* Holds the last version of the Buffered queue that was made durable. The
+     * queue consists out of all the nodes between the head and the tail. It
+     * contains the following fields:
+     *  NVMTail - a pointer to the end of the durable queue.
+     *  NVMHead - a pointer to the head of the durable queue.
+     *  counter - the version of the last durable queue.
+     */
+    class LastNVMData {
+      public:
+        std::atomic<Node*> NVMTail;
+        std::atomic<Node*> NVMHead;
+        long counter;
+    };
+    //=========================End LastNVMData Class=========================//
+
+    //==========================Start Invalid Class==========================//
+    /* The purpose of this class is to make a temporal blocking for the tail.
+     * This block is attached to the tail of the queue in order to take a valid
+     * snapshot of the tail and the head. It inherits from the node class, is
+     * told apart from a node by its ticket of -1, and contains the following
+     * additional fields:
+     * counter - symbols a potential version of the durable queue. It holds the
+     *           version of the current thread that tries to take a snapshot of
+     *           the queue.
+     * tail -    a pointer to the end of the potential durable queue. This tail
+     *           is the tail that the Invalid object is attached to.
+     * head -    a pointer to the potential head of the durable queue. The
+     *           thread would try to make all the nodes between the head and
+     *           tail durable.
+     */
+    class Invalid: public Node {
+      public:
+        int counter;
+        std::atomic<Node*> tail;
+        std::atomic<Node*> head;
+        Invalid(long c) : counter(c), tail(nullptr), head(nullptr) {
+            this->ticket = -1;
+        }
+        Invalid() : Invalid(0) {}
+        Invalid& operator=(const Invalid& i) {
+            counter = i.counter;
+            tail = i.tail.load();
+            head = i.head.load();
+            return *this;
+        }
+    };
+    //==========================End Invalid Class============================//
+
+    //========================Start Checkpoints Class========================//
+    /* Every STRIDE-th node of the Buffered queue by ticket, recorded when
+     * sync() or bulkLoad() makes it durable, so that a snapshot can be split without
+     * walking it. The entries live in chunks of CHUNK entries that are
+     * allocated on first use and kept until the queue is destroyed, and only
+     * the first CHUNKS chunks are recorded. Nothing is flushed: after a crash
+     * the index is dropped and filled again by the next syncs.
+     */
+    class Checkpoints {
+      public:
+
+        static constexpr long STRIDE = 1024;
+        static constexpr long CHUNK = 1024;
+        static constexpr long CHUNKS = 4096;
+
+        Checkpoints() {
+            for (long i = 0; i < CHUNKS; i++) {
+                chunks[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~Checkpoints() {
+            for (long i = 0; i < CHUNKS; i++) {
+                delete[] chunks[i].load();
+            }
+        }
+
+        // Records the node if its ticket is a multiple of STRIDE.
+        void record(Node* node) {
+            long ticket = node->ticket;
+            if (ticket < 0 || ticket % STRIDE != 0 ||
+                ticket / STRIDE >= CHUNK * CHUNKS) {
+                return;
+            }
+            long slot = ticket / STRIDE;
+            std::atomic<Node*>* chunk = chunks[slot / CHUNK].load();
+            if (chunk == nullptr) {
+                std::atomic<Node*>* fresh = new std::atomic<Node*>[CHUNK]();
+                if (chunks[slot / CHUNK].compare_exchange_strong(chunk,
+                                                                 fresh)) {
+                    chunk = fresh;
+                } else {
+                    delete[] fresh;  // Another sync installed it first
+                }
+            }
+            chunk[slot % CHUNK].store(node, std::memory_order_release);
+        }
+
+        /* Returns the recorded node with the largest ticket that is not
+         * larger than the given one, if it is at least from, or nullptr.
+         */
+        Node* find(long ticket, long from) const {
+            if (ticket < 0) {
+                return nullptr;
+            }
+            long slot = ticket / STRIDE;
+            if (slot >= CHUNK * CHUNKS || slot * STRIDE < from) {
+                return nullptr;
+            }
+            std::atomic<Node*>* chunk = chunks[slot / CHUNK].load();
+            if (chunk == nullptr) {
+                return nullptr;
+            }
+            Node* node = chunk[slot % CHUNK].load(std::memory_order_acquire);
+            return node != nullptr && node->ticket == slot * STRIDE ?
+                   node : nullptr;
+        }
+
+        /* Forgets all the recorded nodes. Used by recover(), where the
+         * chunks may belong to the process that crashed, so they are
+         * dropped without being freed.
+         */
+        void clear() {
+            for (long i = 0; i < CHUNKS; i++) {
+                chunks[i].store(nullptr);
+            }
+        }
+
+      private:
+        std::atomic<std::atomic<Node*>*> chunks[CHUNKS];
+    };
+    //=========================End Checkpoints Class=========================//
+
+    //==========================Start Snapshot Class=========================//
+    /* A read-only view of a durable snapshot of the Buffered queue: the values
+     * of the nodes after NVMHead up to and including NVMTail, in queue order.
+     * Nothing is copied and enq and deq are not blocked, since the nodes are
+     * never freed and the next pointers before NVMTail do not change once
+     * linked. The size comes from the tickets of the two ends. It contains
+     * the following fields:
+     * before - the node before the first node of the view.
+     * count  - the number of nodes in the view.
+     * marks  - the checkpoints of the queue, used to split the view.
+     */
+    class Snapshot {
+      public:
+
+        class Iterator {
+          public:
+            Iterator(Node* n, long r) : node(n), remaining(r) {}
+            const T& operator*() const { return node->value; }
+            Iterator& operator++() {
+                if (--remaining > 0) {
+                    node = node->next.load(std::memory_order_acquire);
+                }
+                return *this;
+            }
+            bool operator!=(const Iterator& other) const {
+                return remaining != other.remaining;
+            }
+          private:
+            Node* node;
+            long remaining;
+        };
+
+        Snapshot(Node* b, long c, const Checkpoints* m) :
+            before(b), count(c > 0 ? c : 0), marks(m) {}
+
+        long size() const { return count; }
+
+        Iterator begin() const {
+            return Iterator(count > 0 ? before->next.load() : nullptr, count);
+        }
+
+        Iterator end() const { return Iterator(nullptr, 0); }
+
+        /* Splits the view into k consecutive views of nearly the same size,
+         * which can be scanned by k threads. Each view starts from the
+         * closest checkpoint before it, so finding where they start walks at
+         * most STRIDE nodes per view rather than the whole view, and reads no
+         * values. Only the nodes that no sync recorded yet, such as those
+         * before a crash, are walked from the previous view. k should be at
+         * least 1. A smaller k is taken as 1, so the view is not split.
+         */
+        std::vector<Snapshot> partition(int k) const {
+            if (k < 1) {
+                k = 1;
+            }
+            std::vector<Snapshot> parts;
+            Node* start = before;
+            long startTicket = before->ticket;
+            for (int i = 0; i < k; i++) {
+                long partSize = count / k + (i < count % k ? 1 : 0);
+                parts.push_back(Snapshot(start, partSize, marks));
+                long target = startTicket + partSize;
+                Node* mark = marks->find(target, startTicket);
+                if (mark != nullptr) {
+                    start = mark;
+                    startTicket = mark->ticket;
+                }
+                for (; startTicket < target; startTicket++) {
+                    start = start->next.load();
+                }
+            }
+            return parts;
+        }
+
+      private:
+        Node* before;
+        long count;
+        const Checkpoints* marks;
+    };
+    //==========================End Snapshot Class===========================//
+
+    // The removedValues array of the Durable policy. Each thread id has an
+    // entrance where is saves the last node it managed to dequeue. Relevant
+    // in case there is a crash after the value was removed and before the
+    // value was returned to the caller.
+    PolicyArray<durable, RemovedValue*> removedValues;
+
+    // The LogEntry array of the Detectable policy. Each thread id has an
+    // entrance where is saves the last operation that was asked by the user.
+    // Recovery reads a copy of it, taken with logs.copy().
+    PolicyArray<detectable, LogEntry*> logs;
+
+    // The checkpoints of the Buffered policy, which split its snapshots.
+    typename std::conditional<buffered, Checkpoints, NoArray>::type
+        checkpoints;
+
+    /* The constructor of the queue. Makes the head and tail point to a durable
+     * dummy node, and initializes the snapshot of the Buffered policy.
+     */
+    PersistentQueue() {
+        Node* dummy = allocNode<Node>();
+        if constexpr (eager || buffered) {
+            barrierNode(dummy);  // Flush the dummy node before connecting it
+        }
+        head = tail = dummy;
+        if constexpr (eager || buffered) {
+            barrier(&head);
+            barrier(&tail);
+        }
+        // The entries of removedValues and logs start null once allocated
+        if constexpr (buffered) {
+            LastNVMData* d = allocNode<LastNVMData>();
+            d->NVMTail = dummy;
+            d->NVMHead = dummy;
+            d->counter = -1;
+            barrier(d);
+            data = d;
+            barrier(&data);
+        }
+        counter = 0;
+        segments = nullptr;
+        segmentTail = nullptr;
+    }
+
+    //-------------------------------------------------------------------------
+
+    void initialize() {
+        std::vector<T> values(QUEUE_SIZE);
+        for (int i = 0; i < QUEUE_SIZE; i++){
+            values[i] = i+1;
+        }
+        bulkLoad(values.data(), QUEUE_SIZE);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Appends count nodes with the given values, in order, for filling the
+     * queue before it is shared: no other operation may run concurrently.
+     * The nodes are allocated in one block and are already linked to each
+     * other when they are written with streaming stores, so they are never
+     * read into the cache and a single fence persists all of them. If the
+     * value is not trivially copyable, or the Flush primitive tracks lines
+     * (Msync only persists the lines it was given), the nodes are constructed
+     * in place instead, and all their lines are flushed with a single fence.
+     * The block is then linked after the tail and the tail is moved to its
+     * end, with one barrier each. Under the Buffered policy the block also
+     * becomes the durable snapshot, together with the nodes enqueued since the
+     * last sync.
+     */
+    void bulkLoad(const T* values, long count) {
+        if (count <= 0) {
+            return;
+        }
+        constexpr bool streamed = (eager || buffered) && trivialValue &&
+                                  !Flush::tracksLines;
+        Node* nodes = allocNodes<Node>(count);
+        Node* last = tail.load();
+        for (long i = 0; i < count; i++) {
+            Node* next = i + 1 < count ? &nodes[i + 1] : nullptr;
+            if constexpr (streamed) {
+                Node staged(values[i]);
+                staged.next.store(next, std::memory_order_relaxed);
+                if constexpr (detectable) {
+                    staged.logEnq = LogEntry(false, &nodes[i], insert, -1, -1);
+                } else if constexpr (buffered) {
+                    staged.ticket = last->ticket + i + 1;
+                }
+                STREAM_STORE(&nodes[i], &staged, sizeof(Node));
+                TRACE_STREAM(&nodes[i]);
+            } else if constexpr (eager || buffered) {
+                Node* node = new (&nodes[i]) Node(values[i]);
+                node->next.store(next, std::memory_order_relaxed);
+                if constexpr (detectable) {
+                    node->logEnq = LogEntry(false, node, insert, -1, -1);
+                } else if constexpr (buffered) {
+                    node->ticket = last->ticket + i + 1;
+                }
+                TRACE_STORE(node);
+            } else {
+                Node* node = new (&nodes[i]) Node(values[i]);
+                node->next.store(next, std::memory_order_relaxed);
+            }
+        }
+        Node* end = &nodes[count - 1];
+        if constexpr ((eager || buffered) && !streamed) {
+            barrierLines(nodes, sizeof(Node) * count);
+        }
+        if constexpr (buffered) {
+            // Its last fence also persists the streamed nodes
+            makeDurble(data.load()->NVMTail.load(), last);
+        } else if constexpr (eager) {
+            fence();  // Persist the streamed nodes before linking them
+        }
+        last->next.store(&nodes[0]);
+        tail.store(end);
+        if constexpr (eager || buffered) {
+            TRACE_STORE(&last->next);
+            barrier(&last->next);
+            barrier(&tail);
+        }
+        if constexpr (buffered) {
+            long first = (Checkpoints::STRIDE - (last->ticket + 1) %
+                          Checkpoints::STRIDE) % Checkpoints::STRIDE;
+            for (long i = first; i < count; i += Checkpoints::STRIDE) {
+                checkpoints.record(&nodes[i]);
+            }
+            LastNVMData* potential = allocNode<LastNVMData>();
+            potential->NVMTail = end;
+            potential->NVMHead = head.load();
+            potential->counter = data.load()->counter;
+            barrier(potential);
+            data = potential;
+            barrier(&data);
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Enqueues a node to the queue with the given value. Under the Buffered
+     * policy, returns the ticket of the inserted node, which is durable once
+     * durableTicket() is greater or equal to it. Returns 0 otherwise.
+     */
+    long enq(T value, int threadID = currentThreadID(),
+             int operationNumber = -1) {
+        return enqueue(threadID, operationNumber, std::move(value));
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Enqueues a node whose value is constructed from args in the node, by
+     * the thread of currentThreadID and with no operation number. Returns
+     * like enq.
+     */
+    template <class... Args> long emplace(Args&&... args) {
+        return enqueue(currentThreadID(), -1, std::forward<Args>(args)...);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Tries to dequeue a node. Returns the value of the removed node. If the
+     * queue is empty, it returns INT_MIN which symbols an empty queue.
+     */
+    T deq(int threadID = currentThreadID(), int operationNumber = -1) {
+        std::optional<T> value = try_deq(threadID, operationNumber);
+        return value ? std::move(*value) : T(INT_MIN);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Tries to dequeue a node. Returns the value of the removed node, or an
+     * empty optional if the queue is empty. Under the Durable policy, the
+     * node is first stamped with the threadID - this is what indicates that
+     * the node was removed - and the node is saved in the thread's location
+     * at the removedValues array. Under the Detectable policy, the node is
+     * stamped with the log of the operation. The value is read only by the
+     * thread that removed the node. The Volatile queue moves it out, since
+     * nothing reads a removed node again; the others copy it, since recovery
+     * and snapshots still read it.
+     */
+    std::optional<T> try_deq(int threadID = currentThreadID(),
+                             int operationNumber = -1) {
+        TRACE_OP("PersistentQueue::deq");
+        QUEUE_STAT(statOperations);
+        LogEntry* log = nullptr;
+        RemovedValue* removed = nullptr;
+        if constexpr (durable) {
+            removed = allocNode<RemovedValue>();
+            // Only this thread replaces its entry, and its node is final
+            RemovedValue* last = removedValues[threadID];
+            if (last != nullptr) {
+                Node* lastNode = last->node.load(std::memory_order_relaxed);
+                removed->previous = lastNode != nullptr ? lastNode : last->previous;
+            }
+            TRACE_STORE(removed);
+            barrier(removed);
+            // Helpers read the entry while it is replaced
+            __atomic_store_n(&removedValues[threadID], removed, __ATOMIC_RELEASE);
+            TRACE_STORE(&removedValues[threadID]);
+            barrier(&removedValues[threadID]);
+        } else if constexpr (detectable) {
+            log = createDeqLog(threadID, operationNumber);
+        }
+        while (true) {
+            QUEUE_STAT(statIterations);
+            Node* first = head.load(std::memory_order_acquire);
+            Node* last = tail.load(std::memory_order_acquire);
+            Node* next = first->next.load(std::memory_order_acquire);
+            if (first == head.load(std::memory_order_relaxed)) {
+                // A single producer can leave the tail behind the head, so
+                // the queue is empty whenever the head has no next
+                if (next == nullptr) {  // The queue is empty
+                    if constexpr (durable) {
+                        removed->empty = true;
+                        TRACE_STORE(&removed->empty);
+                        barrier(&removed->empty);
+                    } else if constexpr (detectable) {
+                        log->status = true;
+                        TRACE_STORE(&log->status);
+                        barrier(&log->status);
+                    }
+                    QUEUE_STAT(statEmpty);
+                    return std::nullopt;
+                }
+                if (first == last) {
+                    if constexpr (buffered) {
+                        Invalid* currI = asInvalid(next);
+                        if (currI != nullptr) {  // Check if next is the Invalid node
+                            QUEUE_STAT(statHelpSync);
+                            QUEUE_STAT(statEmpty);
+                            helpSync(currI);  // Help finish taking the snapshot
+                            return std::nullopt;
+                        }
+                    }
+                    if constexpr (eager) {
+                        barrierOpt(&last->next);
+                    }
+                    if constexpr (!plainEnq) {
+                        // If next is a node, help promote the tail
+                        QUEUE_STAT(statHelpTail);
+                        COUNT_CAS(statCasTail, moveTail(last, next));
+                        continue;
+                    }
+                    // The single producer moves the tail by itself, and next
+                    // is already linked, so it can be removed
+                }
+                if constexpr (durable) {
+                    // Mark the node as removed by changing the threadID field
+                    if (claim(next, threadID, log)) {
+                        TRACE_STORE(&next->threadID);
+                        barrier(&next->threadID);
+                        removed->node.store(next, std::memory_order_relaxed);
+                        TRACE_STORE(&removed->node);
+                        barrierOpt(&removed->node);
+                        advanceHead(first, next); // Update head
+                        return next->value;
+                    } else {
+                        RemovedValue* other = __atomic_load_n(
+                            &removedValues[next->threadID.load(std::memory_order_acquire)],
+                            __ATOMIC_ACQUIRE);
+                        if (head.load(std::memory_order_acquire) == first){ //same context
+                            QUEUE_STAT(statHelpDeq);
+                            barrier(&next->threadID);
+                            other->node.store(next, std::memory_order_relaxed);
+                            TRACE_STORE(&other->node);
+                            barrierOpt(&other->node);
+                            advanceHead(first, next);
+                        }
+                    }
+                } else if constexpr (detectable) {
+                    if (claim(next, threadID, log)) {
+                        TRACE_STORE(&next->logDeq);
+                        barrier(&next->logDeq);
+                        connectRemoved(next);  // Connect log to removed node
+                        advanceHead(first, next); // Update head
+                        return next->value;
+                    } else {  // Finish the other thread's operation
+                        if (head.load(std::memory_order_acquire) == first){  // Important! Same context!
+                            QUEUE_STAT(statHelpDeq);
+                            // Update and flush the relevant node in the log
+                            connectRemoved(next);
+                            advanceHead(first, next);
+                        }
+                    }
+                } else if (advanceHead(first, next)) {
+                    if constexpr (buffered) {
+                        return next->value;
+                    } else {
+                        return std::move(next->value);
+                    }
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Moves the first value of this queue to the end of destination as one
+     * detectable operation. Returns false if this queue is empty. The
+     * removed node becomes the dummy of this queue, so the value moves into
+     * a new node, but the node carries the only log of the move: it claims
+     * the removed node like the log of a remove and is the logEnq of the new
+     * node. The source and the value are written to the new node together,
+     * so one flush persists both before the node is linked. The caller is a
+     * consumer of this queue and a producer of destination.
+     */
+    bool moveTo(PersistentQueue& destination, int threadID = currentThreadID(),
+                int operationNumber = -1) {
+        static_assert(detectable, "Only the Detectable policy moves");
+        TRACE_OP("PersistentQueue::moveTo");
+        QUEUE_STAT(statOperations);
+        Node* node = createMoveLogAndNode(threadID, operationNumber);
+        LogEntry* log = &node->logEnq;
+        while (true) {
+            QUEUE_STAT(statIterations);
+            Node* first = head.load(std::memory_order_acquire);
+            Node* last = tail.load(std::memory_order_acquire);
+            Node* next = first->next.load(std::memory_order_acquire);
+            if (first == head.load(std::memory_order_relaxed)) {
+                if (next == nullptr) {  // The queue is empty
+                    log->status = true;
+                    TRACE_STORE(&log->status);
+                    barrier(&log->status);
+                    QUEUE_STAT(statEmpty);
+                    return false;
+                }
+                if (first == last) {
+                    barrierOpt(&last->next);
+                    if constexpr (!plainEnq) {
+                        // If next is a node, help promote the tail
+                        QUEUE_STAT(statHelpTail);
+                        COUNT_CAS(statCasTail, moveTail(last, next));
+                        continue;
+                    }
+                }
+                if (claim(next, threadID, log)) {
+                    TRACE_STORE(&next->logDeq);
+                    barrier(&next->logDeq);
+                    // Connect log to removed node
+                    __atomic_store_n(&log->source, next, __ATOMIC_RELAXED);
+                    node->value = next->value;
+                    TRACE_STORE(node);
+                    barrierNode(node);
+                    advanceHead(first, next);
+                    destination.link(node);
+                    return true;
+                } else if (head.load(std::memory_order_acquire) == first) {  // Same context!
+                    // Finish the other thread's operation
+                    QUEUE_STAT(statHelpDeq);
+                    connectRemoved(next);
+                    advanceHead(first, next);
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Takes a valid snapshot of the Buffered queue. If another thread with a
+     * bigger snapshot version runs concurrently - helps finish the operation
+     * if necessary and returns. Otherwise, does the following two steps:
+     * 1. Blocks the tail and takes a valid snapshot.
+     * 2. Makes all the nodes in the snapshot durable.
+     */
+    void sync([[maybe_unused]] int threadID) {
+        static_assert(buffered, "Only the Buffered policy syncs");
+        TRACE_OP("PersistentQueue::sync");
+	int currentCounter = 0;
+	Invalid* invalid = allocNode<Invalid>(currentCounter);
+	while (true) {
+	    // Block the tail and take a snapshot.
+            LastNVMData* currData = data.load();
+	    bool result = blockTheTail(invalid);
+	    if (result == false) { // Another took more updated snapshot
+	        break;
+	    }
+
+            // Flush all the nodes between the last and the current tail
+	    makeDurble(currData->NVMTail.load(), invalid->tail.load());
+
+	    // Try to update snapshot
+	    LastNVMData* potential = allocNode<LastNVMData>();
+	    potential->NVMTail = invalid->tail.load();
+    	    potential->NVMHead = invalid->head.load();
+	    potential->counter = invalid->counter;
+	    barrier(potential);
+            // currData->counter is smaller than invalid->counter because sampeled
+            // before blocking the tail
+	    if (data.compare_exchange_strong(currData, potential)) {
+		barrier(&data);
+		break;
+	    } else {
+		continue;
+	    }
+	}
+	commitSegments();
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Makes every later sync() of the Buffered queue also append its
+     * snapshot to the given segment file, and return once the file is on
+     * disk. Writes the current snapshot to the file first. Must be called
+     * before the queue is shared. A queue is restored from the file with
+     * bulkLoad of SegmentFile<T>::restore(path).
+     */
+    void attachSegments(SegmentFile<T>* file) {
+        static_assert(buffered, "Only the Buffered policy syncs");
+        static_assert(trivialValue, "Segment files copy the values bytes");
+        segments = file;
+        segmentTail = data.load()->NVMHead.load();
+        commitSegments();
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* This is another way of implementing the sync. If the queue is very small,
+     * this might be a better way once the flushes will not invalidate the cache
+     * when they are called. This sync fulshes everything between the head and
+     * the tail instead of flushing everyhitng between the previos and the
+     * current tail.
+     */ 
+     /*void sync(int threadID) {
+	int currentCounter = 0;
+	Invalid* invalid = allocNode<Invalid>(currentCounter);
+	while (true) {
+	    // Block the tail and take a snapshot
+	    bool result = blockTheTail(invalid);
+	    if (result == false) { // Another took a more updated snapshot
+		return;
+	    }
+
+	    // Flush all the nodes between the head and the tail
+	    makeDurble(invalid->head.load(), invalid->tail.load());
+
+ 	    // Try to update the snapshot
+            LastNVMData* currData = data.load();
+	    LastNVMData* potential = allocNode<LastNVMData>();
+	    potential->NVMTail = invalid->tail.load();
+	    potential->NVMHead = invalid->head.load();
+	    potential->counter = invalid->counter;
+	    while (true) {
+                // Check if the potential snapshot is the most updated
+		if (currData->counter < invalid->counter) {
+		    barrier(potential);
+                    if (data.compare_exchange_strong(currData, potential)) {
+			barrier(&data);
+	    		break;
+	       	    } else {  // Another thread has managed to update
+	    		currData = data.load();
+	       	    }
+		} else {  // The potential snapshot has a lower version than
+			  // the snapshot that was updated. Can finish.
+		    break;
+		}
+	    }
+	    return;
+	}
+    }*/
+
+    //-------------------------------------------------------------------------
+
+    /* Blocks the tail and takes valid snapshot of the queue. The snapshot
+     * will be contained out of the tail that was blocked and a head that
+     * was sampled afterwards. The parameters of the function:
+     * invalid - the object that we are blocking the tail with.
+     */
+    bool blockTheTail(Invalid* invalid) {
+        LastNVMData* currData = data.load();
+	int currentCounter = atomic_fetch_add(&counter, 1);
+	Invalid* currI = nullptr;
+	while (true) {
+            // Checks whether the snapshot was taken by a more progressed thread
+	    if (currData->counter > currentCounter) {
+	        return false;
+	    }
+	    invalid->counter = currentCounter;
+            Node* last = tail.load();
+            Node* next = last->next.load();
+	    if (last == tail.load()) {
+	        if (next == nullptr) {
+	            invalid->tail = last;
+                    // Block the tail
+                    Node* invalidNode = invalid;
+                    if (last->next.compare_exchange_strong(next, invalidNode)) {
+                        // Update head
+			Node* valid = nullptr;
+                        invalid->head.compare_exchange_strong(valid, head);
+                        // Remove block
+                        last->next.compare_exchange_strong(invalidNode, nullptr);
+                        return true;
+                    }
+	        } else {
+	            currI = asInvalid(next);
+	            if (currI != nullptr) {  // Another thread is syncing
+			if (currI->counter > currentCounter ||
+	                    currI->head == nullptr) {  // Sync the same range
+			    helpSync(currI);
+	                    *invalid = *currI;
+	                    return true;
+	                }
+                        helpSync(currI);  // Help finish
+	                continue;  // Try again cause the other sync is old
+	            }
+                    tail.compare_exchange_strong(last, next);
+	        }
+	    }
+	}
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Appends the values of the last durable snapshot that are not in the
+     * segment file yet, and its head, and returns once they are on disk. The
+     * thread that takes the lock of the file writes the latest snapshot, so
+     * the threads that waited for it find their snapshots committed and do
+     * not write again.
+     */
+    void commitSegments() {
+        if constexpr (trivialValue) {
+            if (segments == nullptr ||
+                !segments->lock(data.load()->counter)) {
+                return;
+            }
+            // segmentTail is only used under the lock
+            LastNVMData* currData = data.load();
+            Node* last = currData->NVMTail.load();
+            Node* node = segmentTail;
+            while (node != last) {
+                node = node->next.load(std::memory_order_acquire);
+                segments->append(node->ticket, node->value);
+            }
+            segmentTail = last;
+            segments->commit(currData->counter,
+                             currData->NVMHead.load()->ticket,
+                             last->ticket + 1);
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Makes all the nodes between start and end durable.
+     * The parameters of the function:
+     * start         - the node we start making all node durable from.
+     * end           - the last node we make durable.
+     */
+    void makeDurble(Node* start, Node* end) {
+        Node* temp = start;
+        barrierNode(temp);
+        checkpoints.record(temp);
+        while(1) {
+            if (temp == end) {
+                return;
+            }
+            Node* next = temp->next.load();
+            barrierNode(next);
+            checkpoints.record(next);
+            temp = next;
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the ticket of the last node that was made durable by sync(),
+     * or, with a segment file attached, of the last node that the file
+     * committed. Every enqueue that got a smaller or equal ticket is durable.
+     */
+    long durableTicket() {
+        static_assert(buffered, "Only the Buffered policy has tickets");
+        if constexpr (trivialValue) {
+            if (segments != nullptr) {
+                return segments->committedTicket();
+            }
+        }
+        return data.load()->NVMTail.load()->ticket;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns a view of the last durable snapshot of the Buffered queue. The
+     * view stays valid while the queue runs and syncs, and later syncs do not
+     * change it.
+     */
+    Snapshot snapshot() {
+        static_assert(buffered, "Only the Buffered policy has snapshots");
+        LastNVMData* currData = data.load();
+        Node* first = currData->NVMHead.load();
+        Node* last = currData->NVMTail.load();
+        return Snapshot(first, last->ticket - first->ticket, &checkpoints);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Waits until the node with the given ticket is made durable by a sync()
+     * of any thread. It does not call sync() by itself, so some thread must
+     * keep syncing the queue for the function to return.
+     */
+    void waitDurable(long ticket) {
+        while (durableTicket() < ticket) {
+            sched_yield();
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Brings the queue back to a consistent state after a crash. Must run
+     * before any other operation. The Durable queue moves the head past all
+     * the nodes that were marked as removed, and the tail to the last linked
+     * node. The last node that every thread dequeued is still in
+     * removedValues, including a node it claimed before the crash but did not
+     * record yet. The Buffered queue goes back to its last durable
+     * snapshot: every node that was enqueued after the snapshot is cut off,
+     * and every node that was dequeued after it is back in the queue.
+     */
+    void recover() {
+        static_assert(durable || buffered,
+                      "The Detectable policy recovers with recover(logs)");
+        if constexpr (durable) {
+            // The nodes that were claimed after the head, and the last one
+            // that every thread claimed
+            std::vector<Node*> lastClaims;
+            Node* first = head.load();
+            Node* next = first->next.load();
+            while (next != nullptr && next->threadID.load() != -1) {
+                size_t claimer = next->threadID.load();
+                if (claimer >= lastClaims.size()) {
+                    lastClaims.resize(claimer + 1, nullptr);
+                }
+                lastClaims[claimer] = next;
+                first = next;
+                next = first->next.load();
+            }
+            // A dequeue that crashed between its claim and its entry gets
+            // its node. The claims of a thread follow the order of the
+            // queue, so its last claim is either that of its last dequeue
+            // or the node it removed before
+            for (size_t i = 0; i < lastClaims.size(); i++) {
+                if (lastClaims[i] == nullptr) {
+                    continue;
+                }
+                RemovedValue* removed = removedValues[i];
+                if (removed != nullptr && !removed->empty &&
+                    removed->node.load() == nullptr &&
+                    removed->previous != lastClaims[i]) {
+                    removed->node = lastClaims[i];
+                    barrier(&removed->node);
+                }
+            }
+            head = first;
+            barrier(&head);
+            Node* last = tail.load();
+            while (last->next.load() != nullptr) {
+                barrierOpt(&last->next);
+                last = last->next.load();
+            }
+            tail = last;
+            barrier(&tail);
+        } else {
+            LastNVMData* currData = data.load();
+            Node* last = currData->NVMTail.load();
+            last->next = nullptr;
+            barrier(&last->next);
+            head = currData->NVMHead.load();
+            tail = last;
+            barrier(&head);
+            barrier(&tail);
+            checkpoints.clear();
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Tries to finish all the detectable operations from before the last
+     * crash. Must run before any other operation. detectableOps holds the
+     * entries of the logs array from before the crash, as taken by
+     * logs.copy(), indexed by thread id. Once it returns, every entry tells the result of its
+     * operation: an insert always took effect, and a remove either holds the
+     * removed node or has a true status if the queue was empty. A move
+     * either holds its source and took effect, or has a true status and no
+     * source if this queue was empty. The moves of this queue are finished
+     * in destination, which must be the queue they moved into and must
+     * already be recovered.
+     */
+    void recover(std::vector<LogEntry*>& detectableOps,
+                 PersistentQueue* destination = nullptr) {
+        static_assert(detectable, "Only the Detectable policy has logs");
+        updateHead(head);  // Update head to point to the correct location
+        // Update tail to point to the correct location and the status of
+        // all the inserted nodes so that operations won't be executed twice
+        updateTailAndStatus(head, tail);
+        // Execute all unfinished operations from logs array
+        finishPrevOperations(detectableOps, destination);
+        createNewArray();  // Clear the logs array for current session
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Clears the logs array for the current session. It is cleared after all
+     * operations from before the last crash are finished.
+     */
+    void createNewArray() {
+        logs.forEach([this](int, LogEntry*& entry) {
+            entry = nullptr;
+            barrierOpt(&entry);
+        });
+        fence();
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Update head to point to the last node that has a non-NULL logDeq
+     * field. It also flushes and finishes the visible remove operations by
+     * connecting their logs to the removed nodes.
+     */
+    void updateHead(Node* start) {
+        Node* last = nullptr;
+        Node* temp = start->next.load();
+        while (temp && temp->logDeq.load()) {
+            barrier(&temp->logDeq);
+            connectRemoved(temp);  // Connect log to removed node
+            last = temp;
+            temp = temp->next.load();
+        }
+        if (last) {
+            head.compare_exchange_strong(start, last); // Update head
+            barrier(&head);
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Traverse from head to one node before the last node that has a non-NULL
+     * next field. During the traversal, update the status of all the logEnq
+     * operations so they won't be executed twice. It also flushes and finishes
+     * the last visible insert operation.
+     */
+    void updateTailAndStatus(Node* start, Node* prevTail) {
+        Node* temp = start;
+        temp->logEnq.status = true;
+        while (true) {
+            if (!temp->next.load()) {
+                tail.compare_exchange_strong(prevTail, temp); // Update tail
+                barrier(&tail);
+                return;
+            }
+            if (!temp->next.load()->next.load()) {
+                barrier(&temp->next);
+                temp->next.load()->logEnq.status = true;
+                tail.compare_exchange_strong(prevTail, temp->next.load());
+                barrier(&tail);
+                return;
+            }
+            Node* next = temp->next.load();
+            temp = next;
+            temp->logEnq.status = true;
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Traverse the logs array and finish all the detectable and unfinished
+     * operations. Unfinished logDeq would miss the pointer of the removed
+     * node and logEnq would miss a status that has a true value. A move is
+     * finished as a remove from this queue and an insert into destination.
+     */
+    void finishPrevOperations(std::vector<LogEntry*>& detectableOps,
+                              PersistentQueue* destination) {
+        for (size_t i = 0; i < detectableOps.size(); i++) {
+            if (detectableOps[i]) {
+                Action action = detectableOps[i]->action;
+                if (action == insert) {
+                    finishInsert(detectableOps[i]);
+                } else if (action == remove) {
+                    finishRemove(detectableOps[i]);
+                } else if (action == move) {
+                    finishRemove(detectableOps[i]);
+                    if (destination) {
+                        destination->finishMove(detectableOps[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Finishes the insert of a move whose removal is done. The value of the
+     * source may not have reached the new node before the crash if another
+     * thread connected the source, so it is copied again before the node is
+     * linked.
+     */
+    void finishMove(LogEntry* entry) {
+        if (entry->source == nullptr || entry->status ||
+            entry->node->logDeq.load()) {
+            return;
+        }
+        // The destination is recovered, so the node is not linked yet
+        entry->node->value = entry->source->value;
+        barrierNode(entry->node);
+        finishInsert(entry);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Finishes an insert operation from the logs array. A node that was
+     * already removed is not reachable from the head, so its status was not
+     * updated by the traversal, but its logDeq is set.
+     */
+    void finishInsert(LogEntry* entry) {
+        while (true) {
+            if (entry->status || entry->node->logDeq.load()) {  // Recheck status
+                return;
+            }
+            Node* last = tail.load();
+            Node* next = last->next.load();
+            if (last == tail.load()) {
+                if (next == nullptr) {
+                    // Try to insert
+                    if (last->next.compare_exchange_strong(next, entry->node)) {
+                        barrier(&last->next);
+                        last->next.load()->logEnq.status = true;
+                        tail.compare_exchange_strong(last, entry->node);
+                        return;
+                    }
+                } else {  // If next is a node, finish the previous operation
+                          // and help promote the tail
+                    barrier(&last->next);
+                    last->next.load()->logEnq.status = true;
+                    tail.compare_exchange_strong(last, next);
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Finishes a remove operation, or the removal of a move, from the logs
+     * array.
+     */
+    void finishRemove(LogEntry* entry) {
+        while (true) {
+            Node* removed = entry->action == move ? entry->source : entry->node;
+            if (removed || entry->status) {  // Recheck status
+                return;
+            }
+            Node* first = head.load();
+            Node* last = tail.load();
+            Node* next = first->next.load();
+            if (first == head.load()) {
+                if (first == last) {
+                    if (next == nullptr) {
+                        entry->status = true;
+                        barrier(&entry->status);
+                        return;
+                    }
+                    barrier(&last->next);
+                    last->next.load()->logEnq.status = true;
+                    tail.compare_exchange_strong(last, next);
+                } else {
+                    LogEntry* valid = nullptr;
+                    if (next->logDeq.compare_exchange_strong(valid, entry)) {
+                        barrier(&next->logDeq);
+                        connectRemoved(next);  // Connect log to removed node
+                        head.compare_exchange_strong(first, next);
+                        return;
+                    } else {  // Finish the other thread's operation
+                        if (head.load() == first){  // Same context!
+                            // Update and flush the relevant node in the log
+                            connectRemoved(next);
+                            head.compare_exchange_strong(first, next);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    // Hot path counters. Empty unless compiled with -DQUEUE_STATS.
+    QueueStats stats;
+
+  protected:
+
+    std::atomic<Node*> head;
+    int padding1[PADDING];
+    std::atomic<Node*> tail;
+    int padding2[PADDING];
+    // The last durable snapshot and the snapshot version counter of the
+    // Buffered policy.
+    std::atomic<LastNVMData*> data;
+    int padding3[PADDING];
+    std::atomic<int> counter;
+    // The segment file of the Buffered policy, if one is attached, and the
+    // last node that was written to it.
+    SegmentFile<T>* segments;
+    Node* segmentTail;
+
+    //-------------------------------------------------------------------------
+
+    using Hooks::flush;
+    using Hooks::fence;
+    using Hooks::barrier;
+    using Hooks::barrierOpt;
+    using Hooks::barrierNode;
+    using Hooks::barrierLines;
+    using Hooks::persistNode;
+
+    //-------------------------------------------------------------------------
+
+    /* Creates a node with a value constructed from args and links it. The
+     * node of an eager policy is durable before it is linked.
+     */
+    template <class... Args>
+    long enqueue(int threadID, int operationNumber, Args&&... args) {
+        TRACE_OP("PersistentQueue::enq");
+        QUEUE_STAT(statOperations);
+        Node* node;
+        if constexpr (detectable) {
+            node = createEnqLogAndNode(threadID, operationNumber,
+                                       std::forward<Args>(args)...);
+        } else if constexpr (durable) {
+            node = createNode([](Node*, Node&) {},
+                              std::forward<Args>(args)...);
+        } else {
+            node = allocNode<Node>(std::in_place, std::forward<Args>(args)...);
+        }
+        return link(node);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Creates a durable node that no other thread can reach yet, with a value
+     * constructed from args. prepare(node, fields) sets the policy fields of
+     * the node in fields. A trivially copyable value is constructed in a
+     * staged node that persistNode writes to its place, so the Streaming
+     * primitives can stream it. Any other value is constructed in the node
+     * itself, since a copy of its bytes would not be a copy of it.
+     */
+    template <class Prepare, class... Args>
+    Node* createNode(Prepare prepare, Args&&... args) {
+        Node* node = allocNodes<Node>(1);
+        if constexpr (trivialValue) {
+            Node staged(std::in_place, std::forward<Args>(args)...);
+            prepare(node, staged);
+            persistNode(node, staged);
+        } else {
+            new (node) Node(std::in_place, std::forward<Args>(args)...);
+            prepare(node, *node);
+            TRACE_STORE(node);
+            barrierNode(node);
+        }
+        return node;
+    }
+
+    /* Links the node after the tail and flushes the link if the policy is
+     * eager. The node must already be durable under an eager policy. Returns
+     * the ticket of the node under the Buffered policy and 0 otherwise.
+     */
+    long link(Node* node) {
+        if constexpr (plainEnq) {
+            // No other thread links nodes or moves the tail
+            QUEUE_STAT(statIterations);
+            Node* last = tail.load(std::memory_order_relaxed);
+            last->next.store(node, std::memory_order_release);
+            if constexpr (eager) {
+                TRACE_STORE(&last->next);
+                barrierOpt(&last->next);
+            }
+            tail.store(node, std::memory_order_release);
+            return 0;
+        }
+        while (true) {
+            QUEUE_STAT(statIterations);
+            Node* last = tail.load(std::memory_order_acquire);
+            Node* next = last->next.load(std::memory_order_acquire);
+            if (last == tail.load(std::memory_order_relaxed)) {
+                if (next == nullptr) {
+                    if constexpr (buffered) {
+                        // The node is still private, so its ticket can be set
+                        // before it is linked after last
+                        node->ticket = last->ticket + 1;
+                    }
+                    // Try to insert.
+                    if (COUNT_CAS(statCasNext,
+                                  last->next.compare_exchange_weak(
+                                      next, node, std::memory_order_release,
+                                      std::memory_order_relaxed))) {
+                        if constexpr (eager) {
+                            TRACE_STORE(&last->next);
+                            barrierOpt(&last->next);
+                        }
+                        COUNT_CAS(statCasTail, moveTail(last, node));
+                        if constexpr (buffered) {
+                            return node->ticket;
+                        }
+                        return 0;
+                    }
+                } else {
+                    if constexpr (buffered) {
+                        Invalid* currI = asInvalid(next);
+                        if (currI != nullptr) {  // Check if next is the Invalid node
+                            QUEUE_STAT(statHelpSync);
+                            helpSync(currI);  // Help finish taking a snapshot
+                            continue;
+                        }
+                    }
+                    // If next is a node, help in promoting the tail
+                    QUEUE_STAT(statHelpTail);
+                    if constexpr (eager) {
+                        barrierOpt(&last->next);
+                    }
+                    COUNT_CAS(statCasTail, moveTail(last, next));
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Marks the node as removed by the calling thread, with its threadID under
+     * the Durable policy or its log under the Detectable policy. Returns
+     * false if another thread marked it first. A single consumer has no one
+     * to race with, so it stores the mark.
+     */
+    bool claim(Node* node, int threadID, LogEntry* log) {
+        if constexpr (durable) {
+            if constexpr (plainDeq) {
+                node->threadID.store(threadID, std::memory_order_release);
+                return true;
+            }
+            int valid = -1;
+            return COUNT_CAS(statCasClaim,
+                             node->threadID.compare_exchange_strong(
+                                 valid, threadID, std::memory_order_acq_rel,
+                                 std::memory_order_acquire));
+        } else {
+            if constexpr (plainDeq) {
+                node->logDeq.store(log, std::memory_order_release);
+                return true;
+            }
+            LogEntry* valid = nullptr;
+            return COUNT_CAS(statCasClaim,
+                             node->logDeq.compare_exchange_strong(
+                                 valid, log, std::memory_order_acq_rel,
+                                 std::memory_order_acquire));
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Moves the head from first to next. Returns false if another thread
+     * moved it first. A single consumer is the only thread that moves the
+     * head, so it stores it, with the order of the CAS. The CAS stays strong: a dequeue that claimed
+     * next returns without retrying, and if the head could stay at first, a
+     * helper that passes the same context check would save next in the
+     * removedValues entry of the claimer's next dequeue.
+     */
+    bool advanceHead(Node* first, Node* next) {
+        if constexpr (plainDeq) {
+            head.store(next, moveOrder);
+            return true;
+        }
+        return COUNT_CAS(statCasHead,
+                         head.compare_exchange_strong(first, next, moveOrder,
+                                                      std::memory_order_relaxed));
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Moves the tail from last to next, which is linked after it. A failed
+     * CAS, spurious or not, leaves the tail for the next operation to move.
+     */
+    bool moveTail(Node* last, Node* next) {
+        return tail.compare_exchange_weak(last, next, moveOrder,
+                                          std::memory_order_relaxed);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the node as an Invalid block of sync() if it is one. */
+    static Invalid* asInvalid(Node* node) {
+        return node->ticket < 0 ? static_cast<Invalid*>(node) : nullptr;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Finishes the snapshot of the sync() that blocked the tail with the
+     * given Invalid node, and removes the block.
+     */
+    void helpSync(Invalid* invalid) {
+        Node* valid = nullptr;
+        invalid->head.compare_exchange_strong(valid, head);
+        Node* invalidNode = invalid;
+        invalid->tail.load()->next.compare_exchange_strong(invalidNode, nullptr);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Creates a log object for the remove operation and connects it to the
+     * array in the relevant entry according to the thread id. */
+    LogEntry* createDeqLog(int threadID, int operationNumber) {
+	LogEntry* log = allocNodes<LogEntry>(1);
+	persistNode(log, LogEntry(false, nullptr, remove, operationNumber,
+                                  threadID));
+
+	logs[threadID] = log;  // Connect the log to its entry
+	TRACE_STORE(&logs[threadID]);
+	barrier(&logs[threadID]);
+	return log;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Creates a node together with the log of its insertion and connects the
+     * log to the array at the relevant entry according to the thread id. Both
+     * live in the same cache line, so one flush persists them. */
+    template <class... Args>
+    Node* createEnqLogAndNode(int threadID, int operationNumber,
+                              Args&&... args) {
+	Node* node = createNode([&](Node* place, Node& fields) {
+	    fields.logEnq = LogEntry(false, place, insert, operationNumber,
+	                             threadID);
+	}, std::forward<Args>(args)...);  // Persist node's and log's contents
+
+	logs[threadID] = &node->logEnq;  // Connect log to the thread's entry
+	TRACE_STORE(&logs[threadID]);
+	barrier(&logs[threadID]);  // Flush the entry content
+
+	return node;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Creates the new node of a move together with the log of the move and
+     * connects the log to the array at the relevant entry according to the
+     * thread id. The value is only known once a node is removed.
+     */
+    Node* createMoveLogAndNode(int threadID, int operationNumber) {
+	Node* node = createNode([&](Node* place, Node& fields) {
+	    fields.logEnq = LogEntry(false, place, move, operationNumber,
+	                             threadID);
+	});  // Persist node's and log's contents
+
+	logs[threadID] = &node->logEnq;
+	TRACE_STORE(&logs[threadID]);
+	barrier(&logs[threadID]);
+	return node;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Connects the log that claimed the removed node to it: sets node for a
+     * remove and source for a move, and flushes it.
+     */
+    static void connectRemoved(Node* removed) {
+        LogEntry* log = removed->logDeq.load(std::memory_order_acquire);
+        // The claimer and its helpers may store the node at the same time
+        if (log->action == move) {
+            __atomic_store_n(&log->source, removed, __ATOMIC_RELAXED);
+            TRACE_STORE(&log->source);
+            barrierOpt(&log->source);
+        } else {
+            __atomic_store_n(&log->node, removed, __ATOMIC_RELAXED);
+            TRACE_STORE(&log->node);
+            barrierOpt(&log->node);
+        }
+    }
+};
+//==========================End PersistentQueue Class========================//
+
+#endif /* PERSISTENT_QUEUE_H_ */
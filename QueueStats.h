@@ -0,0 +1,132 @@
+#ifndef QUEUE_STATS_H_
+#define QUEUE_STATS_H_
+
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include "Utilities.h"
+#include "ThreadRegistry.h"
+
+//===========================Start QueueStats Class==========================//
+/* Counters of the hot paths of a queue. Only compiled in with -DQUEUE_STATS;
+ * otherwise QUEUE_STAT and COUNT_CAS compile to nothing and the class is
+ * empty. Every thread counts into its own cache-line-aligned entry, that of
+ * its currentThreadID in a PerThread array, so no two live threads share an
+ * entry, and the entries are summed on demand. The counters are:
+ * operations - operations that were started.
+ * iterations - iterations of the retry loops. Printed as retries, which are
+ *              the iterations minus the operations.
+ * casTail    - failed CASes of the tail.
+ * casHead    - failed CASes of the head.
+ * casNext    - failed CASes of the next field of the last node.
+ * casClaim   - failed claims of a node by a dequeue (threadID or logDeq).
+ * helpTail   - times the tail was advanced for another enqueue.
+ * helpDeq    - times another thread's claimed dequeue was finished.
+ * helpSync   - times an Invalid node of another sync was removed.
+ * empty      - dequeues that found the queue empty.
+ * slowPath   - operations of the wait-free queue that gave up the fast path
+ *              and were announced for helping.
+ */
+enum StatCounter {statOperations, statIterations, statCasTail, statCasHead,
+                  statCasNext, statCasClaim, statHelpTail, statHelpDeq,
+                  statHelpSync, statEmpty, statSlowPath, NUM_STATS};
+
+#ifdef QUEUE_STATS
+
+class QueueStats {
+  public:
+
+    // Zeroed when its PerThread chunk is allocated. The counters are
+    // volatile, so the chunks come from the heap and are never flushed.
+    class ThreadStats {
+      public:
+        long counts[NUM_STATS];
+    };
+
+    QueueStats() {
+        reset();
+    }
+
+    //-------------------------------------------------------------------------
+
+    void add(StatCounter counter) {
+        threads[currentThreadID()].counts[counter]++;
+    }
+
+    //-------------------------------------------------------------------------
+
+    bool countCas(StatCounter counter, bool succeeded) {
+        if (!succeeded) {
+            add(counter);
+        }
+        return succeeded;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Sums the counter over all the threads. */
+    long total(StatCounter counter) {
+        long sum = 0;
+        threads.forEach([&sum, counter](int, ThreadStats& entry) {
+            sum += entry.counts[counter];
+        });
+        return sum;
+    }
+
+    //-------------------------------------------------------------------------
+
+    void reset() {
+        threads.forEach([](int, ThreadStats& entry) {
+            for (int j = 0; j < NUM_STATS; j++) {
+                entry.counts[j] = 0;
+            }
+        });
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Prints every counter per operation. */
+    void print(std::ostream& out) {
+        const char* names[NUM_STATS] = {"operations", "retries", "casTail",
+                                        "casHead", "casNext", "casClaim",
+                                        "helpTail", "helpDeq", "helpSync",
+                                        "empty", "slowPath"};
+        long ops = total(statOperations);
+        if (ops == 0) {
+            return;
+        }
+        out << "Per op :";
+        for (int i = statIterations; i < NUM_STATS; i++) {
+            long count = total((StatCounter)i);
+            if (i == statIterations) {
+                count -= ops;
+            }
+            out << " " << names[i] << " " << std::setprecision(4)
+                << (double)count / ops;
+        }
+        out << std::endl;
+    }
+
+  private:
+    PerThread<ThreadStats, Transient> threads;
+};
+
+#define QUEUE_STAT(counter) stats.add(counter)
+#define COUNT_CAS(counter, cas) stats.countCas(counter, cas)
+
+#else
+
+class QueueStats {
+  public:
+    long total(StatCounter) { return 0; }
+    void reset() {}
+    void print(std::ostream&) {}
+};
+
+#define QUEUE_STAT(counter)
+#define COUNT_CAS(counter, cas) (cas)
+
+#endif
+//============================End QueueStats Class===========================//
+
+#endif /* QUEUE_STATS_H_ */
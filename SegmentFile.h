@@ -0,0 +1,342 @@
+#ifndef SEGMENT_FILE_H_
+#define SEGMENT_FILE_H_
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Exceptions.h"
+
+//===========================Start SegmentFile Class=========================//
+/* An append-only file that keeps the durable snapshots of a Buffered queue on
+ * a host without persistent memory. Every sync() of a queue that the file is
+ * attached to appends the values that were enqueued since the last snapshot
+ * in the file, and the ticket of the head of the new snapshot, as segments:
+ * a header and up to SEGMENT_VALUES values, covered by a checksum. The writes
+ * are buffered and the file is committed with one fdatasync, under a lock:
+ * the threads that sync while a commit runs wait for it, and the next one
+ * writes the snapshots of all of them with one more fdatasync. A new file is
+ * first written as path.tmp, and replaces path once its first commit is on
+ * disk, so a file that is attached to a restored queue compacts the file it
+ * was restored from. The last segment of every commit is marked with
+ * COMMIT_MAGIC, and only commit() writes it. restore() replays the valid
+ * segments of a file, up to the first torn one, and returns the values of the
+ * last snapshot whose commit segment is in that prefix, so the segments of a
+ * commit that did not finish are never replayed.
+ * The values must be trivially copyable.
+ */
+template <class T> class SegmentFile {
+
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "The values of a segment file are copied byte by byte");
+
+  public:
+
+    static const uint32_t MAGIC = 0x51534547;  // "GESQ"
+    static const uint32_t COMMIT_MAGIC = 0x43534547;  // "GESC"
+    static const uint32_t SEGMENT_VALUES = 64 * 1024;
+    static const size_t WRITE_BATCH = 1024 * 1024;
+
+    //=============================Start Header Class========================//
+    /* The header of a segment. The values follow it directly. It contains
+     * the following fields:
+     * magic       - MAGIC, to tell a segment from garbage, or COMMIT_MAGIC
+     *               for the last segment of a commit.
+     * count       - the number of values in the segment.
+     * firstTicket - the ticket of the first value. A segment without values
+     *               holds the ticket its first value would have had.
+     * headTicket  - the ticket of the head of the snapshot. Every value with
+     *               a bigger ticket is in the queue. Only the head of a
+     *               commit segment is used by restore().
+     * checksum    - covers the other fields and the values.
+     */
+    class Header {
+      public:
+        uint32_t magic;
+        uint32_t count;
+        int64_t firstTicket;
+        int64_t headTicket;
+        uint64_t checksum;
+    };
+    //==============================End Header Class=========================//
+
+    /* Creates path.tmp, which replaces path on the first commit. The first
+     * commit takes any version, so it writes the snapshot the queue had when
+     * the file was attached.
+     */
+    SegmentFile(const char* path)
+        : path(path), tmpPath(std::string(path) + ".tmp"),
+          committedVersion(std::numeric_limits<long>::min()), committedHead(0),
+          lastTicket(std::numeric_limits<long>::min()), open(-1),
+          renamed(false) {
+        fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw SegmentFileException();
+        }
+        buffer.reserve(WRITE_BATCH + sizeof(Header) + sizeof(T));
+    }
+
+    //-------------------------------------------------------------------------
+
+    ~SegmentFile() {
+        close(fd);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Starts a commit of the snapshot with the given version. Returns false,
+     * without taking the lock, if a commit of this or a later snapshot is
+     * already on disk. Otherwise returns true with the lock held, and the
+     * caller appends the new values of the latest snapshot and commits.
+     */
+    bool lock(long version) {
+        if (version <= committed()) {
+            return false;
+        }
+        mutex.lock();
+        if (version <= committedVersion) {  // Committed while we waited
+            mutex.unlock();
+            return false;
+        }
+        return true;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Appends the value with the given ticket to the open segment. The
+     * tickets of the appended values must be consecutive.
+     */
+    void append(long ticket, const T& value) {
+        if (open < 0) {
+            openSegment(ticket);
+        }
+        const char* bytes = (const char*)&value;
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+        Header* header = (Header*)&buffer[open];
+        if (++header->count == SEGMENT_VALUES) {
+            closeSegment(committedHead, MAGIC);
+            if (buffer.size() >= WRITE_BATCH) {
+                writeBuffer();
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Closes the open segment with the head of the snapshot with the given
+     * version, writes the buffered segments and commits them with one
+     * fdatasync. nextTicket is the ticket after the last value of the
+     * snapshot. Releases the lock.
+     */
+    void commit(long version, long headTicket, long nextTicket) {
+        if (open < 0) {
+            openSegment(nextTicket);  // Records the head even without values
+        }
+        closeSegment(headTicket, COMMIT_MAGIC);
+        writeBuffer();
+        if (fdatasync(fd) != 0) {
+            mutex.unlock();
+            throw SegmentFileException();
+        }
+        if (!renamed) {
+            replaceFile();
+        }
+        committedHead = headTicket;
+        __atomic_store_n(&lastTicket, nextTicket - 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&committedVersion, version, __ATOMIC_RELEASE);
+        mutex.unlock();
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* The version of the last snapshot that is on disk. */
+    long committed() {
+        return __atomic_load_n(&committedVersion, __ATOMIC_ACQUIRE);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* The ticket of the last value of the last snapshot that is on disk. */
+    long committedTicket() {
+        return __atomic_load_n(&lastTicket, __ATOMIC_ACQUIRE);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Maps the file at path and returns the values of the last snapshot in
+     * it, in queue order. Replay stops at the first segment that is torn,
+     * has a wrong checksum or does not continue the tickets of the previous
+     * one, and the segments after the last commit segment before it are
+     * dropped. A missing file holds an empty queue.
+     */
+    static std::vector<T> restore(const char* path) {
+        std::vector<T> values;
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return values;
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0 || status.st_size == 0) {
+            close(fd);
+            return values;
+        }
+        size_t size = status.st_size;
+        void* region = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (region == MAP_FAILED) {
+            throw SegmentFileException();
+        }
+        const char* start = (const char*)region;
+        // First pass: find the valid prefix, its last commit and the head of
+        // that commit
+        size_t valid = 0;
+        size_t end = 0;
+        long headTicket = 0;
+        long nextTicket = 0;
+        while (valid + sizeof(Header) <= size) {
+            const Header* header = (const Header*)(start + valid);
+            size_t bytes = sizeof(Header) + (size_t)header->count * sizeof(T);
+            if ((header->magic != MAGIC && header->magic != COMMIT_MAGIC) ||
+                header->count > SEGMENT_VALUES || valid + bytes > size ||
+                (valid > 0 && header->firstTicket != nextTicket) ||
+                checksum(header) != header->checksum) {
+                break;
+            }
+            nextTicket = header->firstTicket + header->count;
+            valid += bytes;
+            if (header->magic == COMMIT_MAGIC) {
+                headTicket = header->headTicket;
+                end = valid;
+            }
+        }
+        // Second pass: collect the values after that head
+        for (size_t offset = 0; offset < end;) {
+            const Header* header = (const Header*)(start + offset);
+            const T* segment = (const T*)(header + 1);
+            for (uint32_t i = 0; i < header->count; i++) {
+                if (header->firstTicket + i > headTicket) {
+                    values.push_back(segment[i]);
+                }
+            }
+            offset += sizeof(Header) + (size_t)header->count * sizeof(T);
+        }
+        munmap(region, size);
+        return values;
+    }
+
+  private:
+
+    std::string path;
+    std::string tmpPath;
+    int fd;
+    std::mutex mutex;
+    long committedVersion;
+    // The head of the last commit. Segments that are closed before the
+    // commit ends hold it, since the head of a snapshot only grows.
+    long committedHead;
+    // The ticket of the last value of the last commit.
+    long lastTicket;
+    // The offset of the header of the open segment in the buffer, or -1.
+    long open;
+    bool renamed;
+    std::vector<char> buffer;
+
+    //-------------------------------------------------------------------------
+
+    void openSegment(long firstTicket) {
+        open = buffer.size();
+        Header header;
+        header.magic = MAGIC;
+        header.count = 0;
+        header.firstTicket = firstTicket;
+        header.headTicket = 0;
+        header.checksum = 0;
+        const char* bytes = (const char*)&header;
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(Header));
+    }
+
+    //-------------------------------------------------------------------------
+
+    void closeSegment(long headTicket, uint32_t magic) {
+        Header* header = (Header*)&buffer[open];
+        header->magic = magic;
+        header->headTicket = headTicket;
+        header->checksum = checksum(header);
+        open = -1;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Writes the closed segments of the buffer. */
+    void writeBuffer() {
+        size_t written = 0;
+        while (written < buffer.size()) {
+            ssize_t result = write(fd, buffer.data() + written,
+                                   buffer.size() - written);
+            if (result < 0) {
+                mutex.unlock();
+                throw SegmentFileException();
+            }
+            written += result;
+        }
+        buffer.clear();
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Moves path.tmp over path, and persists the directory entry. */
+    void replaceFile() {
+        if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+            mutex.unlock();
+            throw SegmentFileException();
+        }
+        size_t slash = path.rfind('/');
+        std::string directory = slash == std::string::npos ? "." :
+                                slash == 0 ? "/" : path.substr(0, slash);
+        int dirFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dirFd >= 0) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+        renamed = true;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* A 64-bit FNV-1a style hash of the header fields and the values of a
+     * segment, taken a word at a time.
+     */
+    static uint64_t checksum(const Header* header) {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        uint64_t fields[3] = {((uint64_t)header->magic << 32) | header->count,
+                              (uint64_t)header->firstTicket,
+                              (uint64_t)header->headTicket};
+        for (uint64_t field : fields) {
+            hash = (hash ^ field) * 0x100000001b3ULL;
+        }
+        const char* bytes = (const char*)(header + 1);
+        size_t size = (size_t)header->count * sizeof(T);
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(uint64_t));
+            hash = (hash ^ word) * 0x100000001b3ULL;
+        }
+        if (i < size) {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes + i, size - i);
+            hash = (hash ^ word) * 0x100000001b3ULL;
+        }
+        return hash;
+    }
+};
+//============================End SegmentFile Class==========================//
+
+#endif /* SEGMENT_FILE_H_ */
@@ -0,0 +1,207 @@
+#ifndef THREAD_REGISTRY_H_
+#define THREAD_REGISTRY_H_
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+#include "Exceptions.h"
+#include "Utilities.h"
+#include "NodeAllocator.h"
+#include "PersistHooks.h"
+
+// The number of ids that currentThreadID ever handed out, which is one more
+// than the biggest id.
+std::atomic<int> numRegisteredThreads(0);
+
+//===========================Start ThreadIDs Class===========================//
+/* The id of a thread that called currentThreadID. A thread takes the smallest
+ * id that an exited thread gave back, or a new one, and gives it back when
+ * it exits, so the ids stay dense from 0 and grow with the threads that are
+ * alive at once rather than with every thread ever created. The entries of a
+ * recycled id in the PerThread arrays are taken over by its next thread.
+ */
+class ThreadIDs {
+  public:
+    int id;
+
+    ThreadIDs() {
+        std::lock_guard<std::mutex> lock(mutex());
+        std::vector<int>& free = freeIDs();
+        if (free.empty()) {
+            id = numRegisteredThreads.fetch_add(1);
+        } else {
+            std::pop_heap(free.begin(), free.end(), std::greater<int>());
+            id = free.back();
+            free.pop_back();
+        }
+    }
+
+    ~ThreadIDs() {
+        std::lock_guard<std::mutex> lock(mutex());
+        freeIDs().push_back(id);
+        std::push_heap(freeIDs().begin(), freeIDs().end(), std::greater<int>());
+    }
+
+  private:
+
+    // A min-heap of the ids of the threads that exited.
+    static std::vector<int>& freeIDs() {
+        static std::vector<int>* free = new std::vector<int>();  // Outlives the threads
+        return *free;
+    }
+
+    static std::mutex& mutex() {
+        static std::mutex* m = new std::mutex();
+        return *m;
+    }
+};
+//============================End ThreadIDs Class============================//
+
+/* Returns the id of the calling thread. A thread gets an id on its first
+ * call and keeps it until it exits, when the id is given back for reuse.
+ * Callers that pass their own thread ids must not mix them with these.
+ */
+int currentThreadID() {
+    static thread_local ThreadIDs ids;
+    return ids.id;
+}
+
+//============================Start PerThread Class==========================//
+/* An entry of type E for every thread id, for the per-thread arrays of the
+ * queues. Every entry takes a cache line of its own, so no two threads share
+ * one. The entries are allocated on demand, SLOTS_PER_CHUNK at a time, from
+ * nodeArena if it is set, and the chunks are reached through a directory of
+ * MAX_CHUNKS pointers, so the memory grows with the ids in use rather than
+ * with MAX_THREADS * PADDING. An id of MAX_CHUNKS * SLOTS_PER_CHUNK or more
+ * throws ThreadIDException.
+ * A chunk starts with every entry set to E() and is persisted before it is
+ * published in the directory, and its directory entry is persisted before
+ * any of its entries is used. Recovery therefore finds every entry that was
+ * ever written through forEach or copy. The chunks and the directory are
+ * persisted with the Flush primitive of the owning queue, so that under
+ * Msync they are committed with its pages. With the Transient primitive the
+ * entries are volatile: the chunks come from the heap, even if nodeArena is
+ * set, and nothing is flushed. This version DOES NOT contain any memory
+ * management.
+ */
+template <class E, class Flush = Clflush> class PerThread
+    : protected PersistHooks<Flush> {
+
+    typedef PersistHooks<Flush> Hooks;
+
+    static constexpr bool persistent = !std::is_same<Flush, Transient>::value;
+
+  public:
+
+    static const int SLOTS_PER_CHUNK = 64;
+    static const int MAX_CHUNKS = 1024;
+
+    class alignas(CACHE_LINE) Slot {
+      public:
+        E value;
+        Slot() : value() {}
+    };
+
+    class Chunk {
+      public:
+        Slot slots[SLOTS_PER_CHUNK];
+    };
+
+    /* Persists an empty directory. */
+    PerThread() {
+        for (int i = 0; i < MAX_CHUNKS; i++) {
+            directory[i].store(nullptr, std::memory_order_relaxed);
+        }
+        if constexpr (persistent) {
+            for (int i = 0; i < MAX_CHUNKS; i += CACHE_LINE / sizeof(Chunk*)) {
+                barrierOpt(&directory[i]);
+            }
+            fence();
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the entry of the given thread id, and allocates its chunk if
+     * this is the first use of an id in it.
+     */
+    E& operator[](int id) {
+        return chunk(id / SLOTS_PER_CHUNK)->slots[id % SLOTS_PER_CHUNK].value;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Calls f(id, entry) for every entry of every published chunk. */
+    template <class F> void forEach(F f) {
+        for (int i = 0; i < MAX_CHUNKS; i++) {
+            Chunk* published = directory[i].load();
+            if (published == nullptr) {
+                continue;
+            }
+            for (int j = 0; j < SLOTS_PER_CHUNK; j++) {
+                f(i * SLOTS_PER_CHUNK + j, published->slots[j].value);
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the entries indexed by thread id, up to the last published
+     * chunk. The ids of chunks that were never published get E().
+     */
+    std::vector<E> copy() {
+        std::vector<E> entries;
+        forEach([&entries](int id, E& entry) {
+            entries.resize(id + 1);
+            entries[id] = entry;
+        });
+        return entries;
+    }
+
+  private:
+
+    std::atomic<Chunk*> directory[MAX_CHUNKS];
+
+    using Hooks::fence;
+    using Hooks::barrier;
+    using Hooks::barrierOpt;
+
+    //-------------------------------------------------------------------------
+
+    Chunk* chunk(int index) {
+        if (index < 0 || index >= MAX_CHUNKS) {
+            throw ThreadIDException();
+        }
+        Chunk* published = directory[index].load();
+        if (published != nullptr) {
+            return published;
+        }
+        if constexpr (!persistent) {
+            Chunk* fresh = new Chunk();
+            if (directory[index].compare_exchange_strong(published, fresh)) {
+                published = fresh;
+            } else {
+                delete fresh;
+            }
+            return published;
+        }
+        Chunk* fresh = allocNode<Chunk>();
+        for (int i = 0; i < SLOTS_PER_CHUNK; i++) {
+            barrierOpt(&fresh->slots[i]);
+        }
+        fence();  // The entries are durable before the chunk is published
+        if (directory[index].compare_exchange_strong(published, fresh)) {
+            published = fresh;
+        } else {
+            freeNode(fresh);
+        }
+        barrier(&directory[index]);
+        return published;
+    }
+};
+//=============================End PerThread Class===========================//
+
+#endif /* THREAD_REGISTRY_H_ */
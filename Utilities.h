@@ -4,25 +4,94 @@
 #include <stddef.h> 			//for null
 #include <climits>				//for max int
 #include <fstream>
+#ifdef CRASH_INJECTION
+#include <atomic>
+#include <signal.h>
+#endif
+#ifdef PERSIST_TRACE
+#include <atomic>
+#include <stdio.h>
+#endif
 
 #define MAX_THREADS 144
 #define FACTOR 100000
 #define PADDING 512             // Padding must be multiple of 4 for proper alignment
 #define QUEUE_SIZE 1000000
+#define CACHE_LINE 64
+#ifndef NODE_ALIGNMENT
+#define NODE_ALIGNMENT CACHE_LINE  // Must be a power of 2 and at least 8
+#endif
 #define CAS __sync_bool_compare_and_swap
 #define MFENCE __sync_synchronize
 
 std::ofstream file;
 
+// Number of flushes issued by the current thread. Only updated when compiled
+// with -DCOUNT_FLUSHES.
+thread_local long flushCount = 0;
+
+#ifdef CRASH_INJECTION
+// The number of flushes and fences left until the process kills itself.
+// Crash injection is off while it is 0.
+std::atomic<long> crashCountdown(0);
+#endif
+
+/* A point where a crash can be injected. Only active when compiled with
+ * -DCRASH_INJECTION. Every FLUSH and SFENCE is such a point.
+ */
+void CRASH_POINT() {
+#ifdef CRASH_INJECTION
+    if (crashCountdown.load(std::memory_order_relaxed) > 0 &&
+        crashCountdown.fetch_sub(1) == 1) {
+        raise(SIGKILL);
+    }
+#endif
+}
+
+/* Writes back the cache line of p. The memory clobber keeps the compiler from
+ * moving stores to the line past the flush, which relaxed and release atomics
+ * would otherwise allow.
+ */
 void FLUSH(void *p) {
-    asm volatile ("clflush (%0)" :: "r"(p));
+    CRASH_POINT();
+#ifdef COUNT_FLUSHES
+    flushCount++;
+#endif
+    asm volatile ("clflush (%0)" :: "r"(p) : "memory");
 }
 
 void FLUSH(volatile void *p) {   
-    asm volatile ("clflush (%0)" :: "r"(p));
+    CRASH_POINT();
+#ifdef COUNT_FLUSHES
+    flushCount++;
+#endif
+    asm volatile ("clflush (%0)" :: "r"(p) : "memory");
+}
+
+/* Writes back a cache line like FLUSH, but is not ordered with other flushes,
+ * so only a fence makes it durable. Requires a CPU with clflushopt.
+ */
+void FLUSHOPT(volatile void *p) {
+    CRASH_POINT();
+#ifdef COUNT_FLUSHES
+    flushCount++;
+#endif
+    asm volatile ("clflushopt (%0)" :: "r"(p) : "memory");
+}
+
+/* Writes back a cache line without evicting it. Like FLUSHOPT, only a fence
+ * makes it durable. Requires a CPU with clwb.
+ */
+void CLWB(volatile void *p) {
+    CRASH_POINT();
+#ifdef COUNT_FLUSHES
+    flushCount++;
+#endif
+    asm volatile ("clwb (%0)" :: "r"(p) : "memory");
 }
 
 void SFENCE() {
+    CRASH_POINT();
     asm volatile ("sfence" ::: "memory");
 }
 
@@ -44,5 +113,232 @@ void BARRIER_OPT(volatile void* p) {
 	FLUSH(p);
 }
 
+/* Copies bytes to dst with non-temporal stores (movnti). The stores bypass
+ * the cache, so the lines they write need no flush: the next SFENCE makes
+ * them durable. dst must be aligned to 8 bytes and bytes a multiple of 8.
+ */
+void STREAM_STORE(void* dst, const void* src, size_t bytes) {
+    long long* to = (long long*)dst;
+    const long long* from = (const long long*)src;
+    for (size_t i = 0; i < bytes / sizeof(long long); i++) {
+        asm volatile ("movnti %1, %0" : "=m"(to[i]) : "r"(from[i]));
+    }
+}
+
+/* Writes the record src to dst with streaming stores and fences, in place of
+ * storing it through the cache and persisting it with BARRIER_NODE. The lines
+ * of dst are neither read for ownership nor flushed, so it suits records that
+ * are written whole and not read again soon, like fresh nodes. A record that
+ * starts at a 16-byte boundary and fills whole 16-byte words is written with
+ * movntdq, any other with movnti.
+ */
+template <class N> void STREAM_NODE(N* dst, const N* src) {
+    static_assert(sizeof(N) % sizeof(long long) == 0,
+                  "A streamed record must fill whole 8-byte words");
+    if ((size_t)dst % 16 == 0 && sizeof(N) % 16 == 0) {
+        char* to = (char*)dst;
+        const char* from = (const char*)src;
+        for (size_t i = 0; i < sizeof(N); i += 16) {
+            asm volatile ("movdqu (%1), %%xmm0\n\t"
+                          "movntdq %%xmm0, (%0)"
+                          :: "r"(to + i), "r"(from + i) : "xmm0", "memory");
+        }
+    } else {
+        STREAM_STORE(dst, src, sizeof(N));
+    }
+    SFENCE();
+}
+
+/* Reads the time stamp counter of the current core. */
+unsigned long long RDTSC() {
+    unsigned int lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* Flushes all the cache lines of the given node and fences. A node that is
+ * aligned to a cache line and fits in one is flushed with a single FLUSH.
+ */
+template <class N> void BARRIER_NODE(N* node) {
+	if (alignof(N) >= CACHE_LINE && sizeof(N) <= CACHE_LINE) {
+		BARRIER(node);
+		return;
+	}
+	char* line = (char*)((size_t)node & ~(size_t)(CACHE_LINE - 1));
+	char* end = (char*)node + sizeof(N);
+	for (; line < end; line += CACHE_LINE) {
+		FLUSH(line);
+	}
+	SFENCE();
+}
+
+#ifdef PERSIST_TRACE
+//===============================Start Trace=================================//
+/* An instrumentation build that records every flush, fence and annotated
+ * store into per-thread ring buffers. Enabled with -DPERSIST_TRACE. The
+ * FLUSH, SFENCE, BARRIER, BARRIER_OPT and BARRIER_NODE calls are replaced by
+ * macros that record the call site, and the queues mark the stores to their
+ * persistent fields with TRACE_STORE and the beginning of every operation
+ * with TRACE_OP. dumpTrace writes the buffers to a file that is analyzed
+ * offline by analyzeTrace.py. Each buffer keeps the last TRACE_CAPACITY
+ * events of its thread id.
+ */
+#define TRACE_CAPACITY (1 << 20)
+
+enum TraceKind {traceFlush, traceFence, traceStore, traceOp, traceStream};
+
+struct TraceEvent {
+    unsigned long long tsc;
+    const volatile void* address;
+    const char* site;  // The file of the call, or the name of an operation
+    int line;
+    int kind;
+};
+
+struct TraceBuffer {
+    TraceEvent* events;
+    unsigned long long count;
+};
+
+TraceBuffer traceBuffers[MAX_THREADS];
+// One more than the biggest thread id that has a buffer.
+std::atomic<int> numTraceBuffers(0);
+// The events of threads whose id has no buffer.
+std::atomic<unsigned long long> droppedTraceEvents(0);
+
+int currentThreadID();  // In ThreadRegistry.h
+
+/* Returns the buffer of the calling thread, which is keyed by its
+ * currentThreadID. A thread that takes over a recycled id appends to the
+ * events of the thread that had it before. Returns nullptr for an id of
+ * MAX_THREADS or more.
+ */
+TraceBuffer* threadTraceBuffer() {
+    static thread_local TraceBuffer* buffer = nullptr;
+    static thread_local bool registered = false;
+    if (!registered) {
+        registered = true;
+        int id = currentThreadID();
+        if (id >= MAX_THREADS) {
+            return nullptr;
+        }
+        buffer = &traceBuffers[id];
+        if (!buffer->events) {
+            buffer->events = new TraceEvent[TRACE_CAPACITY];
+            buffer->count = 0;
+        }
+        int last = numTraceBuffers.load();
+        while (last < id + 1 &&
+               !numTraceBuffers.compare_exchange_weak(last, id + 1));
+    }
+    return buffer;
+}
+
+void TRACE_EVENT(int kind, const volatile void* address, const char* site,
+                 int line) {
+    TraceBuffer* buffer = threadTraceBuffer();
+    if (!buffer) {
+        droppedTraceEvents.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    TraceEvent& event = buffer->events[buffer->count % TRACE_CAPACITY];
+    event.tsc = RDTSC();
+    event.address = address;
+    event.site = site;
+    event.line = line;
+    event.kind = kind;
+    buffer->count++;
+}
+
+/* Records a store to every cache line of the given range. */
+void TRACE_STORE_LINES(const volatile void* p, size_t size, const char* file,
+                       int line) {
+    size_t address = (size_t)p & ~(size_t)(CACHE_LINE - 1);
+    for (; address < (size_t)p + size; address += CACHE_LINE) {
+        TRACE_EVENT(traceStore, (const volatile void*)address, file, line);
+    }
+}
+
+/* Records a streaming store to every cache line of the given range. */
+void TRACE_STREAM_LINES(const volatile void* p, size_t size, const char* file,
+                        int line) {
+    size_t address = (size_t)p & ~(size_t)(CACHE_LINE - 1);
+    for (; address < (size_t)p + size; address += CACHE_LINE) {
+        TRACE_EVENT(traceStream, (const volatile void*)address, file, line);
+    }
+}
+
+void TRACED_FLUSH(const volatile void* p, const char* file, int line) {
+    TRACE_EVENT(traceFlush, p, file, line);
+    FLUSH((volatile void*)p);
+}
+
+void TRACED_SFENCE(const char* file, int line) {
+    TRACE_EVENT(traceFence, nullptr, file, line);
+    SFENCE();
+}
+
+void TRACED_BARRIER(const volatile void* p, const char* file, int line) {
+    TRACED_FLUSH(p, file, line);
+    TRACED_SFENCE(file, line);
+}
+
+template <class N> void TRACED_BARRIER_NODE(N* node, const char* file,
+                                            int line) {
+    size_t address = (size_t)node & ~(size_t)(CACHE_LINE - 1);
+    for (; address < (size_t)node + sizeof(N); address += CACHE_LINE) {
+        TRACE_EVENT(traceFlush, (const volatile void*)address, file, line);
+    }
+    TRACE_EVENT(traceFence, nullptr, file, line);
+    BARRIER_NODE(node);
+}
+
+/* Writes all the recorded events, one per line:
+ * thread tsc kind address site line
+ * where kind is F(lush), S(fence), W(store), O(peration) or N (a streaming
+ * store, which needs no flush).
+ */
+void dumpTrace(const char* path) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        return;
+    }
+    const char kinds[] = {'F', 'S', 'W', 'O', 'N'};
+    for (int t = 0; t < numTraceBuffers.load(); t++) {
+        TraceBuffer& buffer = traceBuffers[t];
+        if (!buffer.events) {
+            continue;
+        }
+        unsigned long long first = buffer.count > TRACE_CAPACITY ?
+                                   buffer.count - TRACE_CAPACITY : 0;
+        for (unsigned long long i = first; i < buffer.count; i++) {
+            TraceEvent& event = buffer.events[i % TRACE_CAPACITY];
+            fprintf(out, "%d %llu %c %p %s %d\n", t, event.tsc,
+                    kinds[event.kind], (const void*)event.address, event.site,
+                    event.line);
+        }
+    }
+    fclose(out);
+    if (droppedTraceEvents.load() > 0) {
+        fprintf(stderr, "Trace: dropped %llu events of thread ids beyond %d\n",
+                droppedTraceEvents.load(), MAX_THREADS - 1);
+    }
+}
+
+#define FLUSH(p) TRACED_FLUSH((const volatile void*)(p), __FILE__, __LINE__)
+#define SFENCE() TRACED_SFENCE(__FILE__, __LINE__)
+#define BARRIER(p) TRACED_BARRIER((const volatile void*)(p), __FILE__, __LINE__)
+#define BARRIER_OPT(p) TRACED_FLUSH((const volatile void*)(p), __FILE__, __LINE__)
+#define BARRIER_NODE(n) TRACED_BARRIER_NODE(n, __FILE__, __LINE__)
+#define TRACE_STORE(p) TRACE_STORE_LINES(p, sizeof(*(p)), __FILE__, __LINE__)
+#define TRACE_STREAM(p) TRACE_STREAM_LINES(p, sizeof(*(p)), __FILE__, __LINE__)
+#define TRACE_OP(name) TRACE_EVENT(traceOp, nullptr, name, __LINE__)
+//================================End Trace==================================//
+#else
+#define TRACE_STORE(p)
+#define TRACE_STREAM(p)
+#define TRACE_OP(name)
+#endif
+
 #endif /* UTILITIES_H_ */
 
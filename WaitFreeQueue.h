@@ -0,0 +1,434 @@
+#ifndef WAIT_FREE_QUEUE_H_
+#define WAIT_FREE_QUEUE_H_
+
+#include <atomic>
+#include "PersistentQueue.h"
+
+//==========================Start WaitFreeQueue Class========================//
+/* This queue preserves the durable linearizability and detectable execution
+ * definitions like LogQueue, and every operation finishes in a bounded number
+ * of steps. It is Kogan and Petrank's wait-free queue (PPoPP 2011) with the
+ * fast-path/slow-path methodology (PPoPP 2012), on top of the nodes and logs of
+ * LogQueue:
+ * fast path - an operation first runs LogQueue's lock-free loop for at most
+ *             MAX_FAILURES iterations.
+ * slow path - if it did not succeed, it announces itself in the state array
+ *             with a phase that is larger than that of every operation that
+ *             was announced before it, and helps all the announced operations
+ *             with a smaller or equal phase, including itself.
+ * helping   - every HELPING_DELAY operations, a thread helps the announced
+ *             operation of the next thread in a round robin, so no announced
+ *             operation waits for ever.
+ * The persistent state is the same as LogQueue's: every operation is logged
+ * before it starts, the log of a remove is stamped on the removed node, and
+ * the links are flushed before the tail passes them. The announcements are
+ * volatile, so recovery is LogQueue's recovery. This version DOES NOT contain
+ * any memory management.
+ */
+template <class T> class WaitFreeQueue : public PersistentQueue<T, Detectable> {
+
+    typedef PersistentQueue<T, Detectable> Base;
+
+  public:
+
+    typedef typename Base::Node Node;
+    typedef typename Base::LogEntry LogEntry;
+    using Base::insert;
+    using Base::remove;
+    using Base::logs;
+    using Base::stats;
+
+    static const int MAX_FAILURES = 8;
+    static const int HELPING_DELAY = 16;
+
+    //==========================Start OpDesc Class===========================//
+    /* OpDesc is the announcement of an operation on the slow path. It is never
+     * changed; a new descriptor replaces the old one with a CAS of the entry of
+     * its thread in the state array. It contains the following fields:
+     * phase   - the phase of the operation. Helpers finish the operations
+     *           with smaller phases first.
+     * pending - whether the operation is still in progress.
+     * enqueue - whether the operation is an insert or a remove.
+     * node    - the inserted node. For a remove, the head whose successor is
+     *           being removed, and once it is done the removed node, or null
+     *           if the queue was empty.
+     * log     - the log of the operation.
+     */
+    class OpDesc {
+      public:
+        long phase;
+        bool pending;
+        bool enqueue;
+        Node* node;
+        LogEntry* log;
+        OpDesc(long ph, bool pend, bool enq, Node* n, LogEntry* l) :
+            phase(ph), pending(pend), enqueue(enq), node(n), log(l) {}
+    };
+    //===========================End OpDesc Class============================//
+
+    WaitFreeQueue() : phaseCounter(0), numThreads(0) {
+        idle = allocNode<OpDesc>(-1, false, true, nullptr, nullptr);
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Enqueues a node to the queue with the given value. */
+    void enq(T value, int threadID = currentThreadID(),
+             int operationNumber = -1) {
+        TRACE_OP("WaitFreeQueue::enq");
+        QUEUE_STAT(statOperations);
+        registerThread(threadID);
+        helpIfNeeded(threadID);
+        Node* node = this->createEnqLogAndNode(threadID, operationNumber,
+                                               value);
+        for (int i = 0; i < MAX_FAILURES; i++) {  // Fast path
+            QUEUE_STAT(statIterations);
+            Node* last = tail.load();
+            Node* next = last->next.load();
+            if (last == tail.load()) {
+                if (next == nullptr) {
+                    if (COUNT_CAS(statCasNext,
+                                  last->next.compare_exchange_strong(next, node))) {
+                        TRACE_STORE(&last->next);
+                        barrierOpt(&last->next);
+                        COUNT_CAS(statCasTail,
+                                  tail.compare_exchange_strong(last, node));
+                        return;
+                    }
+                } else {  // Finish the insert of next, which may be announced
+                    QUEUE_STAT(statHelpTail);
+                    helpFinishEnq();
+                }
+            }
+        }
+        // Slow path
+        QUEUE_STAT(statSlowPath);
+        long phase = phaseCounter.fetch_add(1);
+        state[threadID] = allocNode<OpDesc>(phase, true, true, node,
+                                            &node->logEnq);
+        help(phase);
+        helpFinishEnq();
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Tries to dequeue a node. Returns the value of the removed node. If the
+     * queue is empty, it returns INT_MIN which symbols an empty queue.
+     */
+    T deq(int threadID = currentThreadID(), int operationNumber = -1) {
+        TRACE_OP("WaitFreeQueue::deq");
+        QUEUE_STAT(statOperations);
+        registerThread(threadID);
+        helpIfNeeded(threadID);
+        LogEntry* log = this->createDeqLog(threadID, operationNumber);
+        for (int i = 0; i < MAX_FAILURES; i++) {  // Fast path
+            QUEUE_STAT(statIterations);
+            Node* first = head.load();
+            Node* last = tail.load();
+            Node* next = first->next.load();
+            if (first == head.load()) {
+                if (first == last) {
+                    if (next == nullptr) {
+                        return empty(log);
+                    }
+                    QUEUE_STAT(statHelpTail);
+                    helpFinishEnq();
+                } else {
+                    LogEntry* valid = nullptr;
+                    if (COUNT_CAS(statCasClaim,
+                                  next->logDeq.compare_exchange_strong(valid, log))) {
+                        TRACE_STORE(&next->logDeq);
+                        barrier(&next->logDeq);
+                        connectRemoved(next);  // Connect log to removed node
+                        COUNT_CAS(statCasHead,
+                                  head.compare_exchange_strong(first, next));
+                        return next->value;
+                    } else {  // Finish the remove that claimed next
+                        QUEUE_STAT(statHelpDeq);
+                        helpFinishDeq();
+                    }
+                }
+            }
+        }
+        // Slow path
+        QUEUE_STAT(statSlowPath);
+        long phase = phaseCounter.fetch_add(1);
+        state[threadID] = allocNode<OpDesc>(phase, true, false, nullptr,
+                                            log);
+        help(phase);
+        helpFinishDeq();
+        Node* node = announcement(threadID)->node;
+        if (node == nullptr) {
+            return empty(log);
+        }
+        return node->value;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* The operations of LogQueue that do not announce themselves. They would
+     * neither be helped nor help the slow path, so they are not offered.
+     */
+    template <class... Args> long emplace(Args&&... args) = delete;
+    std::optional<T> try_deq(int threadID = currentThreadID(),
+                             int operationNumber = -1) = delete;
+    bool moveTo(Base& destination, int threadID = currentThreadID(),
+                int operationNumber = -1) = delete;
+
+    //-------------------------------------------------------------------------
+
+    /* Tries to finish all the detectable operations from before the last
+     * crash, like LogQueue, and clears the announcements, which did not
+     * survive the crash.
+     */
+    void recover(std::vector<LogEntry*>& detectableOps) {
+        Base::recover(detectableOps);
+        idle = allocNode<OpDesc>(-1, false, true, nullptr, nullptr);
+        state.forEach([](int, std::atomic<OpDesc*>& announcement) {
+            announcement = nullptr;
+        });
+    }
+
+    //-------------------------------------------------------------------------
+
+  private:
+
+    using Base::head;
+    using Base::tail;
+    using Base::barrier;
+    using Base::barrierOpt;
+    using Base::connectRemoved;
+
+    //========================Start HelpRecord Class=========================//
+    /* The round robin of a thread over the threads it helps.
+     * nextCheck - the next thread whose announcement is checked.
+     * delay     - the number of operations left until the next check.
+     */
+    class alignas(CACHE_LINE) HelpRecord {
+      public:
+        int nextCheck;
+        int delay;
+        HelpRecord() : nextCheck(0), delay(HELPING_DELAY) {}
+    };
+    //=========================End HelpRecord Class==========================//
+
+    // The announcement of every thread id. Holds a descriptor that is not
+    // pending, or null for idle, while the thread is on the fast path.
+    PerThread<std::atomic<OpDesc*>> state;
+    PerThread<HelpRecord> helpRecords;
+    // The descriptor of the threads that never announced an operation.
+    OpDesc* idle;
+    std::atomic<long> phaseCounter;
+    int padding4[PADDING];
+    // One more than the largest thread id that called an operation. Only
+    // these threads are scanned by the helpers.
+    std::atomic<int> numThreads;
+
+    //-------------------------------------------------------------------------
+
+    void registerThread(int threadID) {
+        int known = numThreads.load(std::memory_order_relaxed);
+        while (threadID >= known &&
+               !numThreads.compare_exchange_weak(known, threadID + 1)) {}
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Marks the remove as done on an empty queue. */
+    T empty(LogEntry* log) {
+        log->status = true;
+        TRACE_STORE(&log->status);
+        barrier(&log->status);
+        QUEUE_STAT(statEmpty);
+        return INT_MIN;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Returns the announcement of the given thread. */
+    OpDesc* announcement(int threadID) {
+        OpDesc* desc = state[threadID].load();
+        return desc != nullptr ? desc : idle;
+    }
+
+    //-------------------------------------------------------------------------
+
+    bool isStillPending(int threadID, long phase) {
+        OpDesc* desc = announcement(threadID);
+        return desc->pending && desc->phase <= phase;
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Every HELPING_DELAY operations, helps the announced operation of the
+     * next thread in the round robin, if there is one.
+     */
+    void helpIfNeeded(int threadID) {
+        HelpRecord& record = helpRecords[threadID];
+        if (--record.delay > 0) {
+            return;
+        }
+        record.delay = HELPING_DELAY;
+        int other = record.nextCheck;
+        record.nextCheck = (other + 1) % numThreads.load();
+        OpDesc* desc = announcement(other);
+        if (desc->pending) {
+            if (desc->enqueue) {
+                helpEnq(other, desc->phase);
+            } else {
+                helpDeq(other, desc->phase);
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Helps all the announced operations with a phase that is smaller or
+     * equal to the given one.
+     */
+    void help(long phase) {
+        int threads = numThreads.load();
+        for (int i = 0; i < threads; i++) {
+            OpDesc* desc = announcement(i);
+            if (desc->pending && desc->phase <= phase) {
+                if (desc->enqueue) {
+                    helpEnq(i, phase);
+                } else {
+                    helpDeq(i, phase);
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Links the node of the announced insert of the given thread. The tail
+     * only passes a node after its insert is marked as done, so a helper
+     * that sees the insert pending never links the node twice.
+     */
+    void helpEnq(int threadID, long phase) {
+        while (isStillPending(threadID, phase)) {
+            Node* last = tail.load();
+            Node* next = last->next.load();
+            if (last == tail.load()) {
+                if (next == nullptr) {
+                    if (isStillPending(threadID, phase)) {
+                        Node* node = announcement(threadID)->node;
+                        if (last->next.compare_exchange_strong(next, node)) {
+                            TRACE_STORE(&last->next);
+                            helpFinishEnq();
+                            return;
+                        }
+                    }
+                } else {
+                    helpFinishEnq();
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Finishes the insert of the node after the tail: flushes its link,
+     * marks its announcement as done if it has one, and promotes the tail.
+     */
+    void helpFinishEnq() {
+        Node* last = tail.load();
+        Node* next = last->next.load();
+        if (next == nullptr) {
+            return;
+        }
+        barrierOpt(&last->next);
+        int threadID = next->logEnq.threadID;
+        if (threadID >= 0) {
+            OpDesc* curDesc = announcement(threadID);
+            if (last == tail.load() && curDesc->pending &&
+                curDesc->node == next) {
+                OpDesc* newDesc = allocNode<OpDesc>(curDesc->phase, false,
+                                                    true, next, curDesc->log);
+                state[threadID].compare_exchange_strong(curDesc, newDesc);
+            }
+        }
+        COUNT_CAS(statCasTail, tail.compare_exchange_strong(last, next));
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Removes a node for the announced remove of the given thread. The
+     * announcement first records the head whose successor it removes, and
+     * only then the successor is stamped with the log of the remove, so a
+     * late helper cannot stamp a second node with the same log.
+     */
+    void helpDeq(int threadID, long phase) {
+        while (isStillPending(threadID, phase)) {
+            Node* first = head.load();
+            Node* last = tail.load();
+            Node* next = first->next.load();
+            if (first == head.load()) {
+                if (first == last) {
+                    if (next == nullptr) {  // The queue is empty
+                        OpDesc* curDesc = announcement(threadID);
+                        if (last == tail.load() &&
+                            isStillPending(threadID, phase)) {
+                            OpDesc* newDesc = allocNode<OpDesc>(
+                                curDesc->phase, false, false, nullptr,
+                                curDesc->log);
+                            state[threadID].compare_exchange_strong(
+                                curDesc, newDesc);
+                        }
+                    } else {
+                        helpFinishEnq();
+                    }
+                } else {
+                    OpDesc* curDesc = announcement(threadID);
+                    Node* node = curDesc->node;
+                    if (!isStillPending(threadID, phase)) {
+                        break;
+                    }
+                    if (first == head.load() && node != first) {
+                        OpDesc* newDesc = allocNode<OpDesc>(
+                            curDesc->phase, true, false, first, curDesc->log);
+                        if (!state[threadID].compare_exchange_strong(
+                                curDesc, newDesc)) {
+                            continue;
+                        }
+                    }
+                    LogEntry* valid = nullptr;
+                    next->logDeq.compare_exchange_strong(valid, curDesc->log);
+                    helpFinishDeq();
+                }
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+
+    /* Finishes the remove that stamped the successor of the head: flushes
+     * the stamp, connects the log to the removed node, marks the announcement
+     * of the remove as done if it has one, and promotes the head.
+     */
+    void helpFinishDeq() {
+        Node* first = head.load();
+        Node* next = first->next.load();
+        if (next == nullptr) {
+            return;
+        }
+        LogEntry* log = next->logDeq.load();
+        if (log == nullptr) {
+            return;
+        }
+        TRACE_STORE(&next->logDeq);
+        barrier(&next->logDeq);
+        connectRemoved(next);  // Connect log to removed node, or a move's source
+        OpDesc* curDesc = announcement(log->threadID);
+        if (first == head.load() && curDesc->pending && curDesc->log == log) {
+            OpDesc* newDesc = allocNode<OpDesc>(curDesc->phase, false, false,
+                                                next, log);
+            state[log->threadID].compare_exchange_strong(curDesc, newDesc);
+        }
+        COUNT_CAS(statCasHead, head.compare_exchange_strong(first, next));
+    }
+};
+//===========================End WaitFreeQueue Class=========================//
+
+#endif /* WAIT_FREE_QUEUE_H_ */
@@ -0,0 +1,118 @@
+#!/usr/bin/python
+# Analyzes a trace of flushes, fences and stores that was written by dumpTrace
+# (a build with -DPERSIST_TRACE, see Utilities.h). The events of all the
+# threads are ordered by their time stamp and the following are reported for
+# every operation type and every call site:
+# redundant - a flush of a cache line that was not stored since it was last
+#             flushed. Lines that were never stored in the trace are skipped.
+# double    - a flush of a line that the same thread already flushed since
+#             its last fence.
+# empty     - a fence with no flush of the same thread since its last fence.
+# missing   - a store to a persistent field whose line is still not flushed
+#             when the storing thread issues its next fence. Reported at the
+#             call site of the store.
+# A streaming store (N) writes a line that needs no flush, so it counts like a
+# store that is flushed at once.
+# Usage: python analyzeTrace.py trace.txt
+import sys
+import os
+from collections import defaultdict
+
+CACHE_LINE = 64
+CATEGORIES = ["redundant", "double", "empty", "missing"]
+
+
+def read_events(path):
+    events = []
+    for line in open(path):
+        parts = line.split()
+        if len(parts) != 6:
+            continue
+        thread, tsc, kind, address, site, number = parts
+        address = int(address, 16) if address not in ("(nil)", "0") else 0
+        if kind != "O":
+            site = "%s:%s" % (os.path.basename(site), number)
+        events.append((int(tsc), int(thread), kind, address, site))
+    events.sort()
+    return events
+
+
+def analyze(events):
+    ops = defaultdict(lambda: defaultdict(int))
+    sites = defaultdict(lambda: defaultdict(int))
+    dirty = {}  # line -> stored since its last flush
+    current_op = defaultdict(lambda: "(none)")
+    flushed = defaultdict(set)  # thread -> lines flushed since its fence
+    stored = defaultdict(dict)  # thread -> line -> site of the store
+    for tsc, thread, kind, address, site in events:
+        line = address & ~(CACHE_LINE - 1)
+        op = current_op[thread]
+        if kind == "O":
+            current_op[thread] = site
+            ops[site]["ops"] += 1
+        elif kind == "W":
+            dirty[line] = True
+            stored[thread][line] = site
+            ops[op]["stores"] += 1
+        elif kind == "N":
+            ops[op]["stores"] += 1
+            dirty[line] = False
+            stored[thread].pop(line, None)
+            flushed[thread].add(line)
+        elif kind == "F":
+            ops[op]["flushes"] += 1
+            if line in dirty and not dirty[line]:
+                ops[op]["redundant"] += 1
+                sites[site]["redundant"] += 1
+            if line in flushed[thread]:
+                ops[op]["double"] += 1
+                sites[site]["double"] += 1
+            flushed[thread].add(line)
+            if line in dirty:
+                dirty[line] = False
+        elif kind == "S":
+            ops[op]["fences"] += 1
+            if not flushed[thread]:
+                ops[op]["empty"] += 1
+                sites[site]["empty"] += 1
+            for stored_line, store_site in stored[thread].items():
+                if dirty.get(stored_line):
+                    ops[op]["missing"] += 1
+                    sites[store_site]["missing"] += 1
+            flushed[thread] = set()
+            stored[thread] = {}
+    return ops, sites
+
+
+def report(ops, sites):
+    header = "%-22s %10s %10s %10s" % ("operation", "ops", "flushes/op",
+                                       "fences/op")
+    for category in CATEGORIES:
+        header += " %10s" % category
+    print(header)
+    for op in sorted(ops):
+        counts = ops[op]
+        num_ops = max(counts["ops"], 1)
+        row = "%-22s %10d %10.2f %10.2f" % (op, counts["ops"],
+                                            float(counts["flushes"]) / num_ops,
+                                            float(counts["fences"]) / num_ops)
+        for category in CATEGORIES:
+            row += " %10d" % counts[category]
+        print(row)
+    print("")
+    print("%-30s %10s %10s" % ("call site", "category", "count"))
+    rows = []
+    for site in sites:
+        for category in CATEGORIES:
+            if sites[site][category]:
+                rows.append((-sites[site][category], site, category))
+    for count, site, category in sorted(rows):
+        print("%-30s %10s %10d" % (site, category, -count))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("Usage: python analyzeTrace.py trace.txt")
+        sys.exit(1)
+    ops, sites = analyze(read_events(sys.argv[1]))
+    report(ops, sites)
@@ -0,0 +1,699 @@
+#include <pthread.h>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <atomic>
+#include <optional>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "MSQueue.h"
+#include "DurableQueue.h"
+#include "LogQueue.h"
+#include "WaitFreeQueue.h"
+#include "RelaxedQueue.h"
+#include "CompactQueue.h"
+#include "HybridQueue.h"
+#include "BlobQueue.h"
+#include "MsyncFlush.h"
+#include "Histogram.h"
+#include "NodeAllocator.h"
+#include "Utilities.h"
+
+using namespace std;
+
+/* A latency benchmark for all the queues. Unlike main.cpp, which reports
+ * the throughput of a fixed enqueue-dequeue loop, every operation here is
+ * timed with the time stamp counter and the tail of the distribution is
+ * reported. The workload is built out of three kinds of threads:
+ * producers - only enqueue.
+ * consumers - only dequeue. Dequeues of an empty queue are counted
+ *             separately and are not part of the latency distribution.
+ * mixed     - repeatedly enqueue E times and then dequeue D times, where E:D
+ *             is the given ratio.
+ * Producers and mixed threads can enqueue in bursts of a given size with a
+ * pause between the bursts. Every configuration in the Cartesian product of
+ * the given lists is run once, after a warm-up period that is not recorded.
+ *
+ * The single producer and single consumer versions of the MS and Durable
+ * queues are named ms-spsc, ms-mpsc, ms-spmc, durable-spsc, durable-mpsc and
+ * durable-spmc. They only run the configurations that they allow.
+ * durable-nt and log-nt write their fresh nodes and log entries with
+ * streaming stores (the Streaming flush primitive), to compare with the
+ * flush path of durable and log.
+ * durable-msync and log-msync flush with Msync: their nodes are in a NodeArena
+ * that is mapped from msync.arena, and every fence joins a group commit with
+ * msync or fdatasync, for hosts with only SSDs. --window sets the batching
+ * window of the commits, and the number of commits is printed after a run.
+ * relaxed-file is the relaxed queue with a SegmentFile attached, so every
+ * sync() also commits the snapshot to relaxed.segments with fdatasync. Run
+ * it with --sync to compare with the sync() of relaxed.
+ *
+ * Usage: ./bench [--queues ms,durable,log,waitfree,compact,hybrid,blob,relaxed] [--producers 0]
+ *                [--consumers 0] [--mixed 1,2,4,8] [--ratio 1:1]
+ *                [--burst 0] [--gap 0] [--prefill 5] [--warmup 1]
+ *                [--duration 5] [--sync 0] [--payload 4] [--window 0]
+ * --burst    - the number of enqueues in a burst. 0 means no bursts.
+ * --gap      - the pause between bursts in nanoseconds.
+ * --prefill  - the number of elements that are inserted before the run.
+ * --warmup   - seconds that are run before recording starts.
+ * --duration - seconds that are recorded.
+ * --sync     - every thread of the relaxed queue calls sync() after this
+ *              number of its own operations. 0 means never.
+ * --payload  - the sizes of the values in bytes: 4 (an int), 8, 64 or 256.
+ *              Values other than an int are only run on ms, durable, log and
+ *              relaxed, which enqueue them with emplace and dequeue them with
+ *              try_deq, and are shown as queue/size. blob takes any size, and
+ *              enqueues blobs of that many bytes.
+ * --window   - the batching window of durable-msync and log-msync in
+ *              microseconds.
+ */
+
+//============================Start Queue Adapters===========================//
+/* The adapters give all the queues the same interface so that a single
+ * worker routine can run all of them.
+ */
+template <class Cardinality = MPMC> class MSQueueAdapter {
+  public:
+    PersistentQueue<int, Volatile, Clflush, Cardinality> queue;
+    typedef Cardinality Threads;
+    void enq(int value, int, int) {
+        queue.enq(value);
+    }
+    int deq(int, int) {
+        return queue.deq();
+    }
+    static const bool syncs = false;
+    void sync(int) {}
+};
+
+template <class Cardinality = MPMC, class Flush = Clflush>
+class DurableQueueAdapter {
+  public:
+    PersistentQueue<int, Durable, Flush, Cardinality> queue;
+    typedef Cardinality Threads;
+    void enq(int value, int, int) {
+        queue.enq(value);
+    }
+    int deq(int threadID, int) {
+        return queue.deq(threadID);
+    }
+    static const bool syncs = false;
+    void sync(int) {}
+};
+
+template <class Flush = Clflush> class LogQueueAdapter {
+  public:
+    PersistentQueue<int, Detectable, Flush> queue;
+    typedef MPMC Threads;
+    void enq(int value, int threadID, int operationNumber) {
+        queue.enq(value, threadID, operationNumber);
+    }
+    int deq(int threadID, int operationNumber) {
+        return queue.deq(threadID, operationNumber);
+    }
+    static const bool syncs = false;
+    void sync(int) {}
+};
+
+class WaitFreeQueueAdapter {
+  public:
+    WaitFreeQueue<int> queue;
+    typedef MPMC Threads;
+    void enq(int value, int threadID, int operationNumber) {
+        queue.enq(value, threadID, operationNumber);
+    }
+    int deq(int threadID, int operationNumber) {
+        return queue.deq(threadID, operationNumber);
+    }
+    static const bool syncs = false;
+    void sync(int) {}
+};
+
+// The slots of a CompactQueue in the benchmark. Only the used ones are
+// touched.
+#define COMPACT_CAPACITY ((uint64_t)1 << 28)
+
+class CompactQueueAdapter {
+  public:
+    CompactQueue<int>* queue;
+    typedef MPMC Threads;
+    CompactQueueAdapter() : queue(CompactQueue<int>::create(COMPACT_CAPACITY)) {}
+    void enq(int value, int, int) {
+        queue->enq(value);
+    }
+    int deq(int threadID, int) {
+        return queue->deq(threadID);
+    }
+    static const bool syncs = false;
+    void sync(int) {}
+};
+
+class HybridQueueAdapter {
+  public:
+    HybridQueue<int> queue;
+    typedef MPMC Threads;
+    void enq(int value, int threadID, int) {
+        queue.enq(value, threadID);
+    }
+    int deq(int threadID, int) {
+        return queue.deq(threadID);
+    }
+    static const bool syncs = false;
+    void sync(int) {}
+};
+
+/* A value of Size bytes. The whole value is written on enqueue and read on
+ * dequeue, like a message would be. */
+template <int Size> class Payload {
+  public:
+    long words[Size / sizeof(long)];
+    Payload() : words() {}
+    explicit Payload(int value) {
+        for (size_t i = 0; i < Size / sizeof(long); i++) {
+            words[i] = value;
+        }
+    }
+};
+
+template <class Policy, int Size> class PayloadQueueAdapter {
+  public:
+    PersistentQueue<Payload<Size>, Policy> queue;
+    typedef MPMC Threads;
+    // The thread ids of emplace and try_deq come from currentThreadID
+    void enq(int value, int, int) {
+        queue.emplace(value);
+    }
+    int deq(int, int) {
+        std::optional<Payload<Size> > value = queue.try_deq();
+        return value ? (int)value->words[0] : INT_MIN;
+    }
+    static const bool syncs = std::is_same<Policy, Buffered>::value;
+    void sync(int threadID) {
+        if constexpr (syncs) {
+            queue.sync(threadID);
+        }
+    }
+};
+
+// The number of bytes of every blob of the blob queue.
+uint32_t blobSize = sizeof(int);
+
+class BlobQueueAdapter {
+  public:
+    BlobQueue<> queue;
+    typedef MPMC Threads;
+    void enq(int value, int, int) {
+        static thread_local vector<char> bytes;
+        bytes.resize(blobSize);
+        memset(bytes.data(), value, blobSize);
+        memcpy(bytes.data(), &value, sizeof(int));
+        queue.enq(bytes.data(), blobSize);
+    }
+    int deq(int threadID, int) {
+        BlobQueue<>::BlobView blob = queue.deq(threadID);
+        if (!blob) {
+            return INT_MIN;
+        }
+        int value;
+        memcpy(&value, blob.data(), sizeof(int));
+        queue.release(threadID);
+        return value;
+    }
+    static const bool syncs = false;
+    void sync(int) {}
+};
+
+class RelaxedQueueAdapter {
+  public:
+    RelaxedQueue<int> queue;
+    typedef MPMC Threads;
+    void enq(int value, int, int) {
+        queue.enq(value);
+    }
+    int deq(int, int) {
+        return queue.deq();
+    }
+    static const bool syncs = true;
+    void sync(int threadID) {
+        queue.sync(threadID);
+    }
+};
+
+// The segment file of relaxed-file. Every run starts it again.
+const char* segmentPath = "relaxed.segments";
+
+class RelaxedFileQueueAdapter : public RelaxedQueueAdapter {
+  public:
+    SegmentFile<int> file;
+    RelaxedFileQueueAdapter() : file(segmentPath) {
+        queue.attachSegments(&file);
+    }
+};
+//=============================End Queue Adapters============================//
+
+enum Role {producer, consumer, mixed};
+enum Phase {waiting, warmup, measure, finished};
+
+/* The parameters of a single run. */
+struct Workload {
+    int producers;
+    int consumers;
+    int mixed;
+    int enqRatio;
+    int deqRatio;
+    int burst;
+    long gap;
+    long prefill;
+    int warmup;
+    int duration;
+    int syncFrequency;
+};
+
+/* The results of a single thread. Every thread writes only to its own
+ * results, which are aligned to cache lines to avoid false sharing.
+ */
+class alignas(CACHE_LINE) ThreadResults {
+  public:
+    LatencyHistogram enqLatency;
+    LatencyHistogram deqLatency;
+    LatencyHistogram syncLatency;
+    uint64_t numEnqs;
+    uint64_t numDeqs;
+    uint64_t numEmptyDeqs;
+    ThreadResults() : numEnqs(0), numDeqs(0), numEmptyDeqs(0) {}
+};
+
+template <class Q> struct WorkerArguments {
+    Q* queue;
+    Role role;
+    int threadID;
+    const Workload* workload;
+    ThreadResults* results;
+};
+
+std::atomic<int> phase(waiting);
+double cyclesPerNs = 1;
+
+//==============================Start Worker=================================//
+
+template <class Q> void* worker(void* argsInput) {
+    WorkerArguments<Q>* args = (WorkerArguments<Q>*)argsInput;
+    Q& queue = *args->queue;
+    const Workload& workload = *args->workload;
+    ThreadResults& results = *args->results;
+    int threadID = args->threadID;
+    int enqs = args->role == consumer ? 0 : workload.enqRatio;
+    int deqs = args->role == producer ? 0 : workload.deqRatio;
+    if (args->role != mixed) {  // Single operation type
+        enqs = enqs > 0 ? 1 : 0;
+        deqs = deqs > 0 ? 1 : 0;
+    }
+    unsigned long long gapCycles = workload.gap * cyclesPerNs;
+    int operationNumber = 0;
+    long inBurst = 0;
+    long sinceSync = 0;
+
+    while (phase.load() == waiting) {
+        sched_yield();
+    }
+
+    while (true) {
+        int currentPhase = phase.load(std::memory_order_relaxed);
+        if (currentPhase == finished) {
+            break;
+        }
+        bool record = currentPhase == measure;
+        for (int i = 0; i < enqs; i++) {
+            unsigned long long start = RDTSC();
+            queue.enq(threadID, threadID, operationNumber++);
+            unsigned long long end = RDTSC();
+            if (record) {
+                results.enqLatency.record(end - start);
+                results.numEnqs++;
+            }
+            if (workload.burst > 0 && ++inBurst == workload.burst) {
+                inBurst = 0;
+                unsigned long long until = RDTSC() + gapCycles;
+                while (RDTSC() < until) {}
+            }
+        }
+        for (int i = 0; i < deqs; i++) {
+            unsigned long long start = RDTSC();
+            int value = queue.deq(threadID, operationNumber++);
+            unsigned long long end = RDTSC();
+            if (record) {
+                if (value == INT_MIN) {
+                    results.numEmptyDeqs++;
+                } else {
+                    results.deqLatency.record(end - start);
+                    results.numDeqs++;
+                }
+            }
+        }
+        sinceSync += enqs + deqs;
+        if (Q::syncs && workload.syncFrequency > 0 &&
+            sinceSync >= workload.syncFrequency) {
+            sinceSync = 0;
+            unsigned long long start = RDTSC();
+            queue.sync(threadID);
+            unsigned long long end = RDTSC();
+            if (record) {
+                results.syncLatency.record(end - start);
+            }
+        }
+    }
+    return 0;
+}
+
+//===============================End Worker==================================//
+
+/* Prints one line of the results table. */
+void printLine(const string& queueName, const Workload& workload,
+               const string& operation, uint64_t numOps, double seconds,
+               const LatencyHistogram& latency) {
+    cout << left << setw(13) << queueName << right
+         << setw(4) << workload.producers << setw(4) << workload.consumers
+         << setw(4) << workload.mixed << "  " << left << setw(6) << operation
+         << right << setw(12) << (uint64_t)(numOps / seconds)
+         << setw(10) << (uint64_t)(latency.percentile(0.5) / cyclesPerNs)
+         << setw(10) << (uint64_t)(latency.percentile(0.99) / cyclesPerNs)
+         << setw(10) << (uint64_t)(latency.percentile(0.999) / cyclesPerNs)
+         << setw(12) << (uint64_t)(latency.max / cyclesPerNs) << endl;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Runs a single configuration on a newly created queue and prints its
+ * results. Configurations with more producers or consumers than the queue
+ * allows are skipped. */
+template <class Q> void runWorkload(const string& queueName,
+                                    const Workload& workload) {
+    if ((Q::Threads::singleProducer &&
+         workload.producers + workload.mixed > 1) ||
+        (Q::Threads::singleConsumer &&
+         workload.consumers + workload.mixed > 1)) {
+        return;
+    }
+    // In the arena of runMsync, so the flushes of the head and tail count
+    Q* queue = allocNode<Q>();
+    for (long i = 0; i < workload.prefill; i++) {
+        queue->enq(i + 1, 0, -1);
+    }
+
+    int numThreads = workload.producers + workload.consumers + workload.mixed;
+    vector<pthread_t> threads(numThreads);
+    vector<WorkerArguments<Q> > arguments(numThreads);
+    vector<ThreadResults*> results(numThreads);
+    for (int i = 0; i < numThreads; i++) {
+        results[i] = allocNode<ThreadResults>();
+        arguments[i].queue = queue;
+        arguments[i].threadID = i;
+        arguments[i].workload = &workload;
+        arguments[i].results = results[i];
+        if (i < workload.producers) {
+            arguments[i].role = producer;
+        } else if (i < workload.producers + workload.consumers) {
+            arguments[i].role = consumer;
+        } else {
+            arguments[i].role = mixed;
+        }
+    }
+
+    phase = waiting;
+    for (int i = 0; i < numThreads; i++) {
+        if (pthread_create(&threads[i], nullptr, worker<Q>, &arguments[i])) {
+            cout << "Error occurred when creating thread" << i << endl;
+            exit(1);
+        }
+    }
+
+    phase = warmup;
+    sleep(workload.warmup);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    phase = measure;
+    sleep(workload.duration);
+    phase = finished;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (int i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], nullptr);
+    }
+    double seconds = (end.tv_sec - start.tv_sec) +
+                     (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    ThreadResults total;
+    for (int i = 0; i < numThreads; i++) {
+        total.enqLatency.merge(results[i]->enqLatency);
+        total.deqLatency.merge(results[i]->deqLatency);
+        total.syncLatency.merge(results[i]->syncLatency);
+        total.numEnqs += results[i]->numEnqs;
+        total.numDeqs += results[i]->numDeqs;
+        total.numEmptyDeqs += results[i]->numEmptyDeqs;
+    }
+    if (total.numEnqs > 0) {
+        printLine(queueName, workload, "enq", total.numEnqs, seconds,
+                  total.enqLatency);
+    }
+    if (total.numDeqs > 0) {
+        printLine(queueName, workload, "deq", total.numDeqs, seconds,
+                  total.deqLatency);
+    }
+    if (total.syncLatency.total > 0) {
+        printLine(queueName, workload, "sync", total.syncLatency.total,
+                  seconds, total.syncLatency);
+    }
+    if (total.numEmptyDeqs > 0) {
+        cout << left << setw(13) << queueName << right
+             << setw(4) << workload.producers << setw(4) << workload.consumers
+             << setw(4) << workload.mixed << "  " << left << setw(6) << "empty"
+             << right << setw(12) << (uint64_t)(total.numEmptyDeqs / seconds)
+             << endl;
+    }
+    // The queues do not contain memory management, so the queue and its
+    // nodes are not freed.
+}
+
+//-----------------------------------------------------------------------------
+
+/* Splits a comma separated list of values. */
+vector<string> splitList(const string& list) {
+    vector<string> values;
+    stringstream stream(list);
+    string value;
+    while (getline(stream, value, ',')) {
+        values.push_back(value);
+    }
+    return values;
+}
+
+//-----------------------------------------------------------------------------
+
+vector<int> splitIntList(const string& list) {
+    vector<int> values;
+    for (const string& value : splitList(list)) {
+        values.push_back(atoi(value.c_str()));
+    }
+    return values;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Runs a single configuration of a PersistentQueue with values of Size
+ * bytes. Returns false if the queue has no such version. */
+template <int Size> bool runPayload(const string& queueName, const string& name,
+                                    const Workload& workload) {
+    if (queueName == "ms") {
+        runWorkload<PayloadQueueAdapter<Volatile, Size> >(name, workload);
+    } else if (queueName == "durable") {
+        runWorkload<PayloadQueueAdapter<Durable, Size> >(name, workload);
+    } else if (queueName == "log") {
+        runWorkload<PayloadQueueAdapter<Detectable, Size> >(name, workload);
+    } else if (queueName == "relaxed") {
+        runWorkload<PayloadQueueAdapter<Buffered, Size> >(name, workload);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+// The batching window of the Msync queues in microseconds.
+long msyncWindow = 0;
+
+/* Runs a single configuration of a queue that flushes with Msync, with its
+ * nodes in a file-backed arena, and prints the number of group commits.
+ */
+template <class Q> void runMsync(const string& queueName,
+                                 const Workload& workload) {
+    NodeArena arena(1L << 30, "msync.arena");
+    nodeArena = &arena;
+    Msync::attach(&arena, msyncWindow);
+    long commits = Msync::commits();
+    long fences = Msync::fences();
+    runWorkload<Q>(queueName, workload);
+    commits = Msync::commits() - commits;
+    fences = Msync::fences() - fences;
+    cout << left << setw(13) << queueName << right << " commits " << commits
+         << " fences " << fences << " fences/commit "
+         << (commits > 0 ? (double)fences / commits : 0) << endl;
+    Msync::attach(nullptr);
+    nodeArena = nullptr;
+    unlink("msync.arena");
+}
+
+//-----------------------------------------------------------------------------
+
+/* Runs a single configuration of the queue with the given name and payload
+ * size. Returns false if there is no such queue. */
+bool runQueue(const string& queueName, int payload, const Workload& workload) {
+    if (queueName == "blob") {
+        blobSize = payload < (int)sizeof(int) ? sizeof(int) : payload;
+        runWorkload<BlobQueueAdapter>(payload == sizeof(int) ? queueName :
+                                      queueName + "/" + to_string(payload),
+                                      workload);
+        return true;
+    }
+    if (payload != sizeof(int)) {
+        string name = queueName + "/" + to_string(payload);
+        if (payload == 8) {
+            return runPayload<8>(queueName, name, workload);
+        } else if (payload == 64) {
+            return runPayload<64>(queueName, name, workload);
+        } else if (payload == 256) {
+            return runPayload<256>(queueName, name, workload);
+        }
+        return false;
+    }
+    if (queueName == "ms") {
+        runWorkload<MSQueueAdapter<> >(queueName, workload);
+    } else if (queueName == "ms-spsc") {
+        runWorkload<MSQueueAdapter<SPSC> >(queueName, workload);
+    } else if (queueName == "ms-mpsc") {
+        runWorkload<MSQueueAdapter<MPSC> >(queueName, workload);
+    } else if (queueName == "ms-spmc") {
+        runWorkload<MSQueueAdapter<SPMC> >(queueName, workload);
+    } else if (queueName == "durable") {
+        runWorkload<DurableQueueAdapter<> >(queueName, workload);
+    } else if (queueName == "durable-nt") {
+        runWorkload<DurableQueueAdapter<MPMC, Streaming<> > >(queueName,
+                                                               workload);
+    } else if (queueName == "durable-spsc") {
+        runWorkload<DurableQueueAdapter<SPSC> >(queueName, workload);
+    } else if (queueName == "durable-mpsc") {
+        runWorkload<DurableQueueAdapter<MPSC> >(queueName, workload);
+    } else if (queueName == "durable-spmc") {
+        runWorkload<DurableQueueAdapter<SPMC> >(queueName, workload);
+    } else if (queueName == "log") {
+        runWorkload<LogQueueAdapter<> >(queueName, workload);
+    } else if (queueName == "log-nt") {
+        runWorkload<LogQueueAdapter<Streaming<> > >(queueName, workload);
+    } else if (queueName == "durable-msync") {
+        runMsync<DurableQueueAdapter<MPMC, Msync> >(queueName, workload);
+    } else if (queueName == "log-msync") {
+        runMsync<LogQueueAdapter<Msync> >(queueName, workload);
+    } else if (queueName == "waitfree") {
+        runWorkload<WaitFreeQueueAdapter>(queueName, workload);
+    } else if (queueName == "compact") {
+        runWorkload<CompactQueueAdapter>(queueName, workload);
+    } else if (queueName == "hybrid") {
+        runWorkload<HybridQueueAdapter>(queueName, workload);
+    } else if (queueName == "relaxed") {
+        runWorkload<RelaxedQueueAdapter>(queueName, workload);
+    } else if (queueName == "relaxed-file") {
+        runWorkload<RelaxedFileQueueAdapter>(queueName, workload);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+    vector<string> queues = splitList("ms,durable,log,relaxed");
+    vector<int> producers(1, 0), consumers(1, 0);
+    vector<int> mixedThreads = splitIntList("1,2,4,8");
+    vector<int> payloads(1, sizeof(int));
+    Workload workload;
+    workload.enqRatio = 1;
+    workload.deqRatio = 1;
+    workload.burst = 0;
+    workload.gap = 0;
+    workload.prefill = 5;
+    workload.warmup = 1;
+    workload.duration = 5;
+    workload.syncFrequency = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        string value = argv[i + 1];
+        if (option == "--queues") {
+            queues = splitList(value);
+        } else if (option == "--producers") {
+            producers = splitIntList(value);
+        } else if (option == "--consumers") {
+            consumers = splitIntList(value);
+        } else if (option == "--mixed") {
+            mixedThreads = splitIntList(value);
+        } else if (option == "--ratio") {
+            sscanf(value.c_str(), "%d:%d", &workload.enqRatio,
+                   &workload.deqRatio);
+        } else if (option == "--burst") {
+            workload.burst = atoi(value.c_str());
+        } else if (option == "--gap") {
+            workload.gap = atol(value.c_str());
+        } else if (option == "--prefill") {
+            workload.prefill = atol(value.c_str());
+        } else if (option == "--warmup") {
+            workload.warmup = atoi(value.c_str());
+        } else if (option == "--duration") {
+            workload.duration = atoi(value.c_str());
+        } else if (option == "--sync") {
+            workload.syncFrequency = atoi(value.c_str());
+        } else if (option == "--payload") {
+            payloads = splitIntList(value);
+        } else if (option == "--window") {
+            msyncWindow = atol(value.c_str());
+        } else {
+            cout << "Unknown option " << option << endl;
+            return 1;
+        }
+    }
+
+    cyclesPerNs = cyclesPerNanosecond();
+    cout << left << setw(13) << "queue" << right << setw(4) << "P"
+         << setw(4) << "C" << setw(4) << "M" << "  " << left << setw(6) << "op"
+         << right << setw(12) << "ops/s" << setw(10) << "p50(ns)"
+         << setw(10) << "p99(ns)" << setw(10) << "p99.9(ns)"
+         << setw(12) << "max(ns)" << endl;
+
+    for (const string& queueName : queues) {
+        for (int payload : payloads) {
+            for (int p : producers) {
+                for (int c : consumers) {
+                    for (int m : mixedThreads) {
+                        if (p + c + m == 0 || p + c + m > MAX_THREADS) {
+                            continue;
+                        }
+                        workload.producers = p;
+                        workload.consumers = c;
+                        workload.mixed = m;
+                        if (!runQueue(queueName, payload, workload)) {
+                            cout << "Unknown queue " << queueName << " with "
+                                 << payload << " byte values" << endl;
+                            return 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,747 @@
+#define CRASH_INJECTION
+
+#include <pthread.h>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <random>
+#include <time.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "DurableQueue.h"
+#include "LogQueue.h"
+#include "WaitFreeQueue.h"
+#include "RelaxedQueue.h"
+#include "CompactQueue.h"
+#include "HybridQueue.h"
+#include "BlobQueue.h"
+#include "MsyncFlush.h"
+#include "NodeAllocator.h"
+#include "Utilities.h"
+
+using namespace std;
+
+/* A crash-injection harness for the durable queues. Every run builds a queue
+ * in a shared NodeArena, and a forked child runs an enqueue-dequeue workload
+ * on it until it is killed. In the "random" mode the parent kills the child
+ * after a random delay. In the "inject" mode the child kills itself at a
+ * random FLUSH or SFENCE (see CRASH_POINT in Utilities.h). In the "points"
+ * mode a child dequeues the only value of a queue and kills itself at the
+ * first FLUSH or SFENCE of the dequeue, then at the second one in a new run,
+ * and so on until the dequeue completes. The parent then recovers the queue
+ * from the arena and reports:
+ * recovery   - the wall time of the recovery function.
+ * lost       - values whose enqueue completed, that were not dequeued by a
+ *              completed dequeue and that are not in the recovered queue.
+ *              A dequeue that was interrupted after it removed a value, and
+ *              that the queue cannot tell about, may account for one lost
+ *              value per thread. These are counted as unresolved instead.
+ * duplicated - values that a completed dequeue returned and that are still
+ *              in the recovered queue, or that appear twice in it.
+ * resolved   - interrupted operations whose result the queue reported
+ *              (the logs of the LogQueue and the removedValues array of the
+ *              DurableQueue).
+ * throughput - enqueue-dequeue pairs per second on the recovered queue.
+ * The points mode reports the number of crash points of the dequeue, and
+ * those after which its value is neither in the recovered queue nor
+ * reported by the recovery (unresolved), or is in both (dup).
+ * The arena is a shared mapping, so every store of the child survives the
+ * crash. The harness checks what the queues make of interrupted operations,
+ * not the loss of cache lines that were not flushed. For the same reason
+ * log-msync, the LogQueue with the Msync primitive, checks its group commit
+ * of the fences and not the disk: msync of the anonymous arena writes nothing.
+ *
+ * Usage: ./crash [--queues durable,log,log-msync,relaxed,segment,waitfree,move,compact,hybrid,blob] [--threads 4] [--runs 10]
+ *                [--mode random|inject|points] [--delay 200] [--sync 100]
+ *                [--prefill 1000] [--arena 4096] [--hugepages 0]
+ * --delay - the maximal delay before a kill in milliseconds (random mode).
+ * --sync  - every thread of the relaxed queue calls sync() after this
+ *           number of its own operations.
+ * --arena - the size of the arena in MB.
+ * --hugepages - 1 backs the arena with huge pages if the system allows it
+ *               (see NodeArena).
+ */
+
+// Values are threadID * VALUE_RANGE + the sequence number of the enqueue.
+#define VALUE_RANGE 10000000
+#define MAX_OPS 1000000  // Enqueues per thread before the child stops
+
+//============================Start ClientRecord Class=======================//
+/* What the child knows about the operations of one of its threads. Lives in
+ * the arena, so the parent can read it after the crash. It contains the
+ * following fields:
+ * enqueued    - the number of completed enqueues.
+ * numDequeued - the number of completed dequeues that returned a value.
+ * dequeued    - the values that completed dequeues returned.
+ */
+class alignas(CACHE_LINE) ClientRecord {
+  public:
+    volatile long enqueued;
+    volatile long numDequeued;
+    int* dequeued;
+    ClientRecord() : enqueued(0), numDequeued(0), dequeued(nullptr) {}
+};
+//=============================End ClientRecord Class========================//
+
+/* What the recovery of a queue told about the interrupted operations. */
+struct Resolution {
+    vector<int> enqueued;
+    vector<int> dequeued;
+    int resolved = 0;
+};
+
+//============================Start Queue Adapters===========================//
+/* The adapters give all the queues the same interface for the workload and
+ * for the recovery.
+ */
+class DurableCrashAdapter {
+  public:
+    DurableQueue<int> queue;
+    void enq(int value, int, int) {
+        queue.enq(value);
+    }
+    int deq(int threadID, int) {
+        return queue.deq(threadID);
+    }
+    void sync(int) {}
+    void recover(int numThreads, Resolution& resolution) {
+        queue.recover();
+        for (int i = 0; i < numThreads; i++) {
+            DurableQueue<int>::RemovedValue* removed = queue.removedValues[i];
+            if (removed && removed->node.load()) {
+                resolution.dequeued.push_back(removed->node.load()->value);
+                resolution.resolved++;
+            }
+        }
+    }
+};
+
+template <class Q = LogQueue<int> > class LogCrashAdapter {
+  public:
+    Q queue;
+    void enq(int value, int threadID, int operationNumber) {
+        queue.enq(value, threadID, operationNumber);
+    }
+    int deq(int threadID, int operationNumber) {
+        return queue.deq(threadID, operationNumber);
+    }
+    void sync(int) {}
+    void recover(int numThreads, Resolution& resolution) {
+        typedef typename Q::LogEntry LogEntry;
+        vector<LogEntry*> detectableOps = queue.logs.copy();
+        queue.recover(detectableOps);
+        for (int i = 0; i < numThreads && i < (int)detectableOps.size(); i++) {
+            LogEntry* entry = detectableOps[i];
+            if (!entry) {
+                continue;
+            }
+            if (entry->action == Q::insert) {
+                resolution.enqueued.push_back(entry->node->value);
+            } else if (entry->action == Q::remove &&
+                       entry->node) {
+                resolution.dequeued.push_back(entry->node->value);
+            }
+            resolution.resolved++;
+        }
+    }
+};
+
+// The slots of a CompactQueue in the crash runs, enough for MAX_OPS
+// enqueue-dequeue pairs of 4 threads.
+#define COMPACT_CAPACITY ((uint64_t)1 << 24)
+
+class CompactCrashAdapter {
+  public:
+    CompactQueue<int>* queue;
+    CompactCrashAdapter() : queue(CompactQueue<int>::create(COMPACT_CAPACITY)) {}
+    void enq(int value, int, int) {
+        queue->enq(value);
+    }
+    int deq(int threadID, int) {
+        return queue->deq(threadID);
+    }
+    void sync(int) {}
+    void recover(int numThreads, Resolution& resolution) {
+        queue->recover();
+        for (int i = 0; i < numThreads; i++) {
+            int* value = queue->removedValue(i);
+            if (value && *value != INT_MAX && *value != INT_MIN) {
+                resolution.dequeued.push_back(*value);
+                resolution.resolved++;
+            }
+        }
+    }
+};
+
+class HybridCrashAdapter {
+  public:
+    HybridQueue<int> queue;
+    void enq(int value, int threadID, int) {
+        queue.enq(value, threadID);
+    }
+    int deq(int threadID, int) {
+        return queue.deq(threadID);
+    }
+    void sync(int) {}
+    void recover(int numThreads, Resolution& resolution) {
+        queue.recover(numThreads);
+        for (int i = 0; i < numThreads; i++) {
+            int* value = queue.removedValue(i);
+            if (value) {
+                resolution.dequeued.push_back(*value);
+                resolution.resolved++;
+            }
+        }
+    }
+};
+
+/* Every value is a blob of 100 to 4095 bytes, depending on the value, that
+ * starts with the value and is filled with its low byte. A dequeue checks the
+ * whole blob, so a blob that was not durable when it was linked is reported.
+ */
+class BlobCrashAdapter {
+  public:
+    BlobQueue<> queue;
+    void enq(int value, int, int) {
+        char bytes[4096];
+        uint32_t size = blobSize(value);
+        memset(bytes, value, size);
+        memcpy(bytes, &value, sizeof(int));
+        queue.enq(bytes, size);
+    }
+    int deq(int threadID, int) {
+        int value = valueOf(queue.deq(threadID));
+        queue.release(threadID);
+        return value;
+    }
+    void sync(int) {}
+    void recover(int numThreads, Resolution& resolution) {
+        queue.recover();
+        // A crash in release leaves a released blob that the harness did
+        // not record, so the entries are read whether released or not
+        for (int i = 0; i < numThreads; i++) {
+            BlobQueue<>::RemovedBlob* removed = queue.removedBlobs[i];
+            if (removed && removed->blob.load()) {
+                resolution.dequeued.push_back(valueOf(BlobQueue<>::BlobView(removed->blob.load())));
+                resolution.resolved++;
+            }
+        }
+    }
+  private:
+    static uint32_t blobSize(int value) {
+        return 100 + (uint32_t)value % 3996;
+    }
+    static int valueOf(BlobQueue<>::BlobView blob) {
+        if (!blob) {
+            return INT_MIN;
+        }
+        int value;
+        memcpy(&value, blob.data(), sizeof(int));
+        bool whole = blob.size() == blobSize(value);
+        for (uint32_t i = sizeof(int); whole && i < blob.size(); i++) {
+            whole = blob.data()[i] == (char)value;
+        }
+        if (!whole) {
+            cout << "Blob of " << value << " is corrupted" << endl;
+            exit(1);
+        }
+        return value;
+    }
+};
+
+/* Forwards every value through a second queue: a dequeue moves the first
+ * value of the inbound queue to the outbound queue with one detectable
+ * operation, and then dequeues from the outbound queue. The outbound queue
+ * is recovered first, so the inbound queue can finish its moves into it.
+ */
+class MoveCrashAdapter {
+  public:
+    typedef LogQueue<int>::LogEntry LogEntry;
+    LogQueue<int> inbound;
+    LogQueue<int> outbound;
+    void enq(int value, int threadID, int operationNumber) {
+        inbound.enq(value, threadID, operationNumber);
+    }
+    int deq(int threadID, int operationNumber) {
+        inbound.moveTo(outbound, threadID, operationNumber);
+        return outbound.deq(threadID, operationNumber);
+    }
+    void sync(int) {}
+    void recover(int numThreads, Resolution& resolution) {
+        vector<LogEntry*> inboundOps = inbound.logs.copy();
+        vector<LogEntry*> outboundOps = outbound.logs.copy();
+        outbound.recover(outboundOps);
+        inbound.recover(inboundOps, &outbound);
+        inboundOps.resize(numThreads);
+        outboundOps.resize(numThreads);
+        for (int i = 0; i < numThreads; i++) {
+            LogEntry* in = inboundOps[i];
+            LogEntry* out = outboundOps[i];
+            if (in && in->action == LogQueue<int>::insert) {
+                resolution.enqueued.push_back(in->node->value);
+            }
+            if (out && out->node) {
+                resolution.dequeued.push_back(out->node->value);
+            }
+            if (in || out) {
+                resolution.resolved++;
+            }
+        }
+    }
+};
+
+class RelaxedCrashAdapter {
+  public:
+    RelaxedQueue<int> queue;
+    void enq(int value, int, int) {
+        queue.enq(value);
+    }
+    int deq(int, int) {
+        return queue.deq();
+    }
+    void sync(int threadID) {
+        queue.sync(threadID);
+    }
+    void recover(int, Resolution&) {
+        queue.recover();
+    }
+};
+
+/* The relaxed queue with a SegmentFile attached. The child commits every
+ * sync() to the file, and recovery builds a new queue out of the file instead
+ * of the arena, like a host without persistent memory would after a crash.
+ */
+class SegmentCrashAdapter : public RelaxedCrashAdapter {
+  public:
+    static constexpr const char* path = "crash.segments";
+    SegmentFile<int> file;
+    SegmentCrashAdapter() : file(path) {
+        queue.attachSegments(&file);
+    }
+    void recover(int, Resolution&) {
+        // The file object holds the state of the child, so the new queue is
+        // left without one
+        vector<int> values = SegmentFile<int>::restore(path);
+        new (&queue) RelaxedQueue<int>();
+        queue.bulkLoad(values.data(), values.size());
+    }
+};
+//=============================End Queue Adapters============================//
+
+struct Options {
+    int numThreads;
+    int runs;
+    bool inject;
+    bool points;
+    int delay;
+    int syncFrequency;
+    int prefill;
+    size_t arenaSize;
+    int arenaOptions;
+};
+
+template <class Q> struct ChildArguments {
+    Q* queue;
+    ClientRecord* record;
+    int threadID;
+    int syncFrequency;
+};
+
+std::atomic<bool> run(false);
+
+//==============================Start Child==================================//
+
+template <class Q> void* childRoutine(void* argsInput) {
+    ChildArguments<Q>* args = (ChildArguments<Q>*)argsInput;
+    Q& queue = *args->queue;
+    ClientRecord& record = *args->record;
+    int threadID = args->threadID;
+    int operationNumber = 0;
+    while (!run.load()) {
+        sched_yield();
+    }
+    while (record.enqueued < MAX_OPS) {
+        queue.enq(threadID * VALUE_RANGE + record.enqueued, threadID,
+                  operationNumber++);
+        record.enqueued = record.enqueued + 1;
+        int value = queue.deq(threadID, operationNumber++);
+        if (value != INT_MIN) {
+            record.dequeued[record.numDequeued] = value;
+            record.numDequeued = record.numDequeued + 1;
+        }
+        if (args->syncFrequency > 0 &&
+            operationNumber % args->syncFrequency == 0) {
+            queue.sync(threadID);
+        }
+    }
+    while (true) {  // Wait to be killed
+        pause();
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Runs the workload of the child process. Never returns. */
+template <class Q> void runChild(Q* queue, ClientRecord* records,
+                                 const Options& options,
+                                 unsigned int seed) {
+    NodeArena::forgetChunk();
+    if (options.inject) {
+        // Roughly a few flushes per operation, so most crashes happen
+        // within the first MAX_OPS operations.
+        std::mt19937 random(seed);
+        crashCountdown = 1 + random() % (MAX_OPS / 2);
+    }
+    vector<pthread_t> threads(options.numThreads);
+    vector<ChildArguments<Q> > arguments(options.numThreads);
+    for (int i = 0; i < options.numThreads; i++) {
+        arguments[i].queue = queue;
+        arguments[i].record = &records[i];
+        arguments[i].threadID = i;
+        arguments[i].syncFrequency = options.syncFrequency;
+        if (pthread_create(&threads[i], nullptr, childRoutine<Q>,
+                           &arguments[i])) {
+            _exit(1);
+        }
+    }
+    run = true;
+    while (true) {
+        pause();
+    }
+}
+
+//===============================End Child===================================//
+
+/* The results of all the runs of a queue. */
+struct Totals {
+    double recoveryMs = 0;
+    double maxRecoveryMs = 0;
+    long completedOps = 0;
+    long lost = 0;
+    long duplicated = 0;
+    long unresolved = 0;
+    long resolved = 0;
+    double throughput = 0;
+};
+
+//-----------------------------------------------------------------------------
+
+double secondsSince(const struct timespec& start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Builds a queue in a new arena, crashes a child that runs on it and
+ * recovers it. Adds the results of the run to the totals.
+ */
+template <class Q> void crashRun(const Options& options, unsigned int seed,
+                                 Totals& totals) {
+    NodeArena arena(options.arenaSize, nullptr, options.arenaOptions);
+    nodeArena = &arena;
+    Msync::attach(&arena);
+    NodeArena::forgetChunk();
+
+    Q* queue = allocNode<Q>();
+    // The prefill is enqueued by an additional thread with the last id.
+    int prefillThread = options.numThreads;
+    ClientRecord* records = (ClientRecord*)arena.allocate(
+        sizeof(ClientRecord) * (options.numThreads + 1), CACHE_LINE);
+    for (int i = 0; i <= options.numThreads; i++) {
+        new (&records[i]) ClientRecord();
+        records[i].dequeued = (int*)arena.allocate(sizeof(int) * MAX_OPS,
+                                                   CACHE_LINE);
+    }
+    for (int i = 0; i < options.prefill; i++) {
+        queue->enq(prefillThread * VALUE_RANGE + i, prefillThread, i);
+        records[prefillThread].enqueued++;
+    }
+
+    pid_t child = fork();
+    if (child < 0) {
+        cout << "Error occurred when forking" << endl;
+        exit(1);
+    }
+    if (child == 0) {
+        runChild(queue, records, options, seed);
+    }
+    if (options.inject) {
+        // Kill the child in case it never reaches its crash point
+        for (int waited = 0; waited < 10000; waited++) {
+            if (waitpid(child, nullptr, WNOHANG) == child) {
+                child = -1;
+                break;
+            }
+            usleep(1000);
+        }
+    } else {
+        std::mt19937 random(seed);
+        usleep(1000 * (random() % (options.delay + 1)));
+    }
+    if (child > 0) {
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+    }
+    NodeArena::forgetChunk();
+
+    // Recovery
+    Resolution resolution;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    queue->recover(options.numThreads, resolution);
+    double recoveryMs = secondsSince(start) * 1000;
+
+    // Compare the recovered queue with what the child knew
+    unordered_map<int, int> recovered;
+    for (int value = queue->deq(0, 0); value != INT_MIN;
+         value = queue->deq(0, 0)) {
+        recovered[value]++;
+    }
+    unordered_set<int> dequeued(resolution.dequeued.begin(),
+                                resolution.dequeued.end());
+    long duplicated = 0;
+    long completedOps = 0;
+    for (int i = 0; i < options.numThreads; i++) {
+        completedOps += records[i].enqueued + records[i].numDequeued;
+        dequeued.insert(records[i].dequeued,
+                        records[i].dequeued + records[i].numDequeued);
+    }
+    for (const auto& entry : recovered) {
+        if (dequeued.count(entry.first)) {
+            duplicated += entry.second;
+        } else {
+            duplicated += entry.second - 1;
+        }
+    }
+    long missing = 0;
+    for (int i = 0; i <= options.numThreads; i++) {
+        for (long j = 0; j < records[i].enqueued; j++) {
+            int value = i * VALUE_RANGE + j;
+            if (!dequeued.count(value) && !recovered.count(value)) {
+                missing++;
+            }
+        }
+    }
+    // An interrupted dequeue that removed a value without reporting it
+    long unresolved = options.numThreads - resolution.resolved;
+    long lost = missing > unresolved ? missing - unresolved : 0;
+
+    // Post-recovery throughput on the recovered queue
+    long pairs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (secondsSince(start) < 0.2) {
+        for (int i = 0; i < 1000; i++) {
+            queue->enq(i, 0, 0);
+            queue->deq(0, 0);
+        }
+        pairs += 1000;
+    }
+    double throughput = 2 * pairs / secondsSince(start);
+
+    totals.recoveryMs += recoveryMs;
+    if (recoveryMs > totals.maxRecoveryMs) {
+        totals.maxRecoveryMs = recoveryMs;
+    }
+    totals.completedOps += completedOps;
+    totals.lost += lost;
+    totals.duplicated += duplicated;
+    totals.unresolved += missing < unresolved ? missing : unresolved;
+    totals.resolved += resolution.resolved;
+    totals.throughput += throughput;
+    nodeArena = nullptr;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Crashes a dequeue of the only value of a new queue at each of its crash
+ * points in turn, and checks that the recovered queue or its recovery tells
+ * about the value exactly once.
+ */
+template <class Q> void crashPoints(const string& queueName,
+                                    const Options& options) {
+    const int value = VALUE_RANGE;
+    long points = 0;
+    long unresolved = 0;
+    long duplicated = 0;
+    for (long point = 1; ; point++) {
+        NodeArena arena(options.arenaSize, nullptr, options.arenaOptions);
+        nodeArena = &arena;
+        Msync::attach(&arena);
+        NodeArena::forgetChunk();
+
+        Q* queue = allocNode<Q>();
+        queue->enq(value, 0, 0);
+        queue->sync(0);
+        pid_t child = fork();
+        if (child < 0) {
+            cout << "Error occurred when forking" << endl;
+            exit(1);
+        }
+        if (child == 0) {
+            NodeArena::forgetChunk();
+            crashCountdown = point;
+            queue->deq(0, 1);
+            _exit(0);
+        }
+        int status;
+        waitpid(child, &status, 0);
+        NodeArena::forgetChunk();
+
+        Resolution resolution;
+        queue->recover(1, resolution);
+        long found = 0;
+        for (int removed : resolution.dequeued) {
+            found += removed == value;
+        }
+        for (int removed = queue->deq(0, 2); removed != INT_MIN;
+             removed = queue->deq(0, 2)) {
+            found += removed == value;
+        }
+        nodeArena = nullptr;
+        if (!WIFSIGNALED(status)) {  // The dequeue passed all the points
+            break;
+        }
+        points++;
+        unresolved += found == 0;
+        duplicated += found > 1;
+    }
+    cout << left << setw(9) << queueName << right << setw(12) << points
+         << setw(12) << unresolved << setw(8) << duplicated << endl;
+}
+
+//-----------------------------------------------------------------------------
+
+template <class Q> void crashQueue(const string& queueName,
+                                   const Options& options) {
+    Totals totals;
+    for (int i = 0; i < options.runs; i++) {
+        crashRun<Q>(options, i + 1, totals);
+    }
+    int runs = options.runs;
+    cout << left << setw(9) << queueName << right << fixed
+         << setprecision(3) << setw(12) << totals.recoveryMs / runs
+         << setw(12) << totals.maxRecoveryMs
+         << setw(12) << totals.completedOps / runs
+         << setw(8) << totals.lost << setw(8) << totals.duplicated
+         << setw(12) << totals.unresolved << setw(10) << totals.resolved
+         << setw(14) << (long)(totals.throughput / runs) << endl;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Runs the mode of the options on a queue of type Q. */
+template <class Q> void checkQueue(const string& queueName,
+                                   const Options& options) {
+    if (options.points) {
+        crashPoints<Q>(queueName, options);
+    } else {
+        crashQueue<Q>(queueName, options);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+    string queues = "durable,log,relaxed";
+    Options options;
+    options.numThreads = 4;
+    options.runs = 10;
+    options.inject = false;
+    options.points = false;
+    options.delay = 200;
+    options.syncFrequency = 100;
+    options.prefill = 1000;
+    options.arenaSize = 4096;
+    options.arenaOptions = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        string value = argv[i + 1];
+        if (option == "--queues") {
+            queues = value;
+        } else if (option == "--threads") {
+            options.numThreads = atoi(value.c_str());
+        } else if (option == "--runs") {
+            options.runs = atoi(value.c_str());
+        } else if (option == "--mode") {
+            options.inject = value == "inject";
+            options.points = value == "points";
+        } else if (option == "--delay") {
+            options.delay = atoi(value.c_str());
+        } else if (option == "--sync") {
+            options.syncFrequency = atoi(value.c_str());
+        } else if (option == "--prefill") {
+            options.prefill = atoi(value.c_str());
+        } else if (option == "--arena") {
+            options.arenaSize = atol(value.c_str());
+        } else if (option == "--hugepages") {
+            options.arenaOptions = atoi(value.c_str()) ? NodeArena::HUGE_PAGES : 0;
+        } else {
+            cout << "Unknown option " << option << endl;
+            return 1;
+        }
+    }
+    if (options.numThreads < 1 || options.numThreads >= MAX_THREADS) {
+        cout << "The number of threads must be 1-" << MAX_THREADS - 1 << endl;
+        return 1;
+    }
+    options.arenaSize *= 1024 * 1024;
+
+    if (options.points) {
+        cout << "Mode: points" << endl;
+        cout << left << setw(9) << "queue" << right << setw(12) << "points"
+             << setw(12) << "unresolved" << setw(8) << "dup" << endl;
+    } else {
+        cout << "Mode: " << (options.inject ? "inject" : "random") << " Threads: "
+             << options.numThreads << " Runs: " << options.runs << endl;
+        cout << left << setw(9) << "queue" << right << setw(12) << "recov(ms)"
+             << setw(12) << "max(ms)" << setw(12) << "ops/run" << setw(8)
+             << "lost" << setw(8) << "dup" << setw(12) << "unresolved"
+             << setw(10) << "resolved" << setw(14) << "post ops/s" << endl;
+    }
+
+    stringstream stream(queues);
+    string queueName;
+    while (getline(stream, queueName, ',')) {
+        if (queueName == "durable") {
+            checkQueue<DurableCrashAdapter>(queueName, options);
+        } else if (queueName == "log") {
+            checkQueue<LogCrashAdapter<> >(queueName, options);
+        } else if (queueName == "log-msync") {
+            checkQueue<LogCrashAdapter<PersistentQueue<int, Detectable, Msync> > >(
+                queueName, options);
+        } else if (queueName == "waitfree") {
+            checkQueue<LogCrashAdapter<WaitFreeQueue<int> > >(queueName,
+                                                              options);
+        } else if (queueName == "compact") {
+            checkQueue<CompactCrashAdapter>(queueName, options);
+        } else if (queueName == "hybrid") {
+            checkQueue<HybridCrashAdapter>(queueName, options);
+        } else if (queueName == "blob") {
+            checkQueue<BlobCrashAdapter>(queueName, options);
+        } else if (queueName == "move") {
+            checkQueue<MoveCrashAdapter>(queueName, options);
+        } else if (queueName == "relaxed") {
+            checkQueue<RelaxedCrashAdapter>(queueName, options);
+        } else if (queueName == "segment") {
+            checkQueue<SegmentCrashAdapter>(queueName, options);
+        } else {
+            cout << "Unknown queue " << queueName << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
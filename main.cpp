@@ -4,36 +4,65 @@
 #include <time.h>
 #include <unistd.h>
 #include <assert.h>
+#include <vector>
+#include <string>
+#include <limits>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <iomanip>
+#include <tuple>
+#include <new>
 
 #include <sys/time.h>
+#include <sys/mman.h>
 
 #include "MSQueue.h"
 #include "DurableQueue.h"
 #include "LogQueue.h"
 #include "RelaxedQueue.h"
+#include "PersistentLog.h"
+#include "BlobQueue.h"
+#include "WaitFreeQueue.h"
+#include "NodeAllocator.h"
 #include "Utilities.h"
+#include "MsyncFlush.h"
 
 #define ADD __sync_fetch_and_add
 #define BASIC 1
 
 pthread_t threads[MAX_THREADS];
-int arguments[MAX_THREADS * PADDING];
+int arguments[MAX_THREADS];
 int numThreads = 2;
 int timeForRecord = 5;
-bool run = false, stop = false;
+std::atomic<bool> run(false), stop(false);
 
 MSQueue<int> msQueue;
-int totalNumMSQueueActions = 0;
+long totalNumMSQueueActions = 0;
 
 DurableQueue<int> durableQueue;
-int totalNumDurableQueueActions = 0;
+long totalNumDurableQueueActions = 0;
 
 LogQueue<int> logQueue;
-int totalNumLogQueueActions = 0;
+long totalNumLogQueueActions = 0;
 
 RelaxedQueue<int> relaxedQueue;
-int totalNumRelaxedActions = 0;
-int totalNumSyncActions = 0;
+long totalNumRelaxedActions = 0;
+long totalNumSyncActions = 0;
+
+// Flushes issued by the worker threads. Only counted when compiled with
+// -DCOUNT_FLUSHES. Comparing with a build with -DNODE_ALIGNMENT=8 shows the
+// effect of the cache line aligned nodes.
+long totalNumFlushes = 0;
+
+/* Prints the average number of flushes per operation of the last test. */
+void printFlushes([[maybe_unused]] long totalNumActions) {
+#ifdef COUNT_FLUSHES
+    cout << "Flushes per op : " << (double)totalNumFlushes / totalNumActions
+         << " (node alignment " << NODE_ALIGNMENT << ")" << endl;
+#endif
+}
 
 //====================================Start MSQueue Test====================================
 
@@ -45,17 +74,17 @@ void* startRoutineMSQueue(void* argsInput) {
     int i = *(int*)argsInput;
     unsigned int seed = i + 1;
 
-    while (run == false) {            // busy-wait to start "simultaneously"
-        MFENCE();
+    while (!run.load(std::memory_order_acquire)) {  // busy-wait to start "simultaneously"
         pthread_yield();
     }
 
-    while(!stop){
+    while (!stop.load(std::memory_order_relaxed)) {
         numMyOps+=2;
         queue.enq(i);
         queue.deq();
     }
     ADD(&totalNumMSQueueActions, numMyOps);
+    ADD(&totalNumFlushes, flushCount);
 
     return 0;
 }
@@ -64,23 +93,22 @@ void* startRoutineMSQueue(void* argsInput) {
 void countMSQueue() {
 
     msQueue.initialize();
+    msQueue.stats.reset();  // Count only the measured operations
 
     run = false;
     stop = false;
 
     for (int i = 0; i < numThreads; i++) {
-	arguments[i * PADDING] = i;
-	if(pthread_create(&threads[i], nullptr, startRoutineMSQueue, (void*)&arguments[i * PADDING])){
+	arguments[i] = i;
+	if(pthread_create(&threads[i], nullptr, startRoutineMSQueue, (void*)&arguments[i])){
 	    cout << "Error occurred when creating thread" << i << endl;
 	    exit(1);
 	}
     }
 
-    run = true;
-    MFENCE();
+    run.store(true, std::memory_order_release);
     sleep(timeForRecord);
-    stop = true;
-    MFENCE();
+    stop.store(true, std::memory_order_relaxed);
 
     for (int i = 0; i < numThreads; i++) {
 	pthread_join(threads[i], nullptr);
@@ -88,6 +116,8 @@ void countMSQueue() {
 
     cout << totalNumMSQueueActions/timeForRecord << endl;
     file << totalNumMSQueueActions/timeForRecord << endl;
+    printFlushes(totalNumMSQueueActions);
+    msQueue.stats.print(cout);
 }
 
 
@@ -105,17 +135,17 @@ void* startRoutineDurable(void* argsInput){
     int i = *(unsigned int*)argsInput;
     unsigned int seed = i + 1;
 
-    while (run == false) {            // busy-wait to start "simultaneously"
-        MFENCE();
+    while (!run.load(std::memory_order_acquire)) {  // busy-wait to start "simultaneously"
         pthread_yield();
     }
 
-    while(!stop){
+    while (!stop.load(std::memory_order_relaxed)) {
         numMyOps+=2;
         queue.enq(i);
         queue.deq(i);
     }
     ADD(&totalNumDurableQueueActions, numMyOps);
+    ADD(&totalNumFlushes, flushCount);
 
     return 0;
 }
@@ -124,6 +154,7 @@ void* startRoutineDurable(void* argsInput){
 void countDurable() {
 
     durableQueue.initialize();
+    durableQueue.stats.reset();  // Count only the measured operations
 
     run = false;
     stop = false;
@@ -131,18 +162,16 @@ void countDurable() {
 
     //lock free queue
     for (int i = 0; i < numThreads; i++) {
-        arguments[i * PADDING] = i;
-	if(pthread_create(&threads[i], NULL, startRoutineDurable, (void*)&arguments[i * PADDING])) {
+        arguments[i] = i;
+	if(pthread_create(&threads[i], NULL, startRoutineDurable, (void*)&arguments[i])) {
 	    cout << "Error occurred when creating thread" << i << endl;
 	    exit(1);
 	}
     }
 
-    run = true;
-    MFENCE();
+    run.store(true, std::memory_order_release);
     sleep(timeForRecord);
-    stop=true;
-    MFENCE();
+    stop.store(true, std::memory_order_relaxed);
 
     for (int i = 0; i < numThreads; i++) {
 	pthread_join(threads[i], NULL);
@@ -150,6 +179,8 @@ void countDurable() {
 
     file << totalNumDurableQueueActions/timeForRecord << endl;
     cout << totalNumDurableQueueActions/timeForRecord << endl;
+    printFlushes(totalNumDurableQueueActions);
+    durableQueue.stats.print(cout);
 }
 
 //=====================================End DurableQueue Test===================================
@@ -165,17 +196,17 @@ void* startRoutineLog(void* argsInput){
     int i = *(int*)argsInput;
     unsigned int seed = i + 1;
 
-    while (run == false) {            // busy-wait to start "simultaneously"
-        MFENCE();
+    while (!run.load(std::memory_order_acquire)) {  // busy-wait to start "simultaneously"
         pthread_yield();
     }
 
-    while(!stop){
+    while (!stop.load(std::memory_order_relaxed)) {
         numMyOps+=2;
         queue.enq(i, i, i);
         queue.deq(i, i);
     }
     ADD(&totalNumLogQueueActions, numMyOps);
+    ADD(&totalNumFlushes, flushCount);
 
 
     return 0;
@@ -186,6 +217,7 @@ void* startRoutineLog(void* argsInput){
 void countLog(){
     
     logQueue.initialize();
+    logQueue.stats.reset();  // Count only the measured operations
     
     run = false;
     stop = false;
@@ -193,18 +225,16 @@ void countLog(){
 
     //lock free queue
     for (int i = 0; i < numThreads; i++) {
-        arguments[i * PADDING] = i;
-        if(pthread_create(&threads[i], NULL, startRoutineLog, (void*)&arguments[i * PADDING])){
+        arguments[i] = i;
+        if(pthread_create(&threads[i], NULL, startRoutineLog, (void*)&arguments[i])){
             cout << "Error occurred when creating thread" << i << endl;
             exit(1);
         }
     }
 
-    run = true;
-    MFENCE();
+    run.store(true, std::memory_order_release);
     sleep(timeForRecord);
-    stop=true;
-    MFENCE();
+    stop.store(true, std::memory_order_relaxed);
 
     for (int i = 0; i < numThreads; i++) {
         pthread_join(threads[i], NULL);
@@ -212,6 +242,8 @@ void countLog(){
 
     file << totalNumLogQueueActions/timeForRecord << endl;
     cout << totalNumLogQueueActions/timeForRecord << endl;
+    printFlushes(totalNumLogQueueActions);
+    logQueue.stats.print(cout);
 
 }
 
@@ -230,12 +262,11 @@ void* startRoutineRelaxedQueue(void* argsInput){
     int i = *(unsigned int*)argsInput;
     unsigned int seed = 1;
     
-    while (run == false) {            // busy-wait to start "simultaneously"
-        MFENCE();
+    while (!run.load(std::memory_order_acquire)) {  // busy-wait to start "simultaneously"
         pthread_yield();
     }
     
-    while(!stop){
+    while (!stop.load(std::memory_order_relaxed)) {
         numMyOps+=2;
         queue.enq(0);
         queue.deq();
@@ -246,12 +277,14 @@ void* startRoutineRelaxedQueue(void* argsInput){
     }
     ADD(&totalNumRelaxedActions, numMyOps);
     ADD(&totalNumSyncActions, numMySyncs);
+    ADD(&totalNumFlushes, flushCount);
     return 0;
 }
 
 void countRelaxed(int f){
     
     relaxedQueue.initialize();
+    relaxedQueue.stats.reset();  // Count only the measured operations
     int frequency = f;
     
     relaxedQueue.sync(0);
@@ -264,19 +297,17 @@ void countRelaxed(int f){
     
     
     for (int i=0; i < numThreads; i++) {
-        arguments[i * PADDING] = frequency;
-        if(pthread_create(&threads[i], NULL, startRoutineRelaxedQueue, (void*)&arguments[i * PADDING])){
+        arguments[i] = frequency;
+        if(pthread_create(&threads[i], NULL, startRoutineRelaxedQueue, (void*)&arguments[i])){
             cout << "Error occurred when creating thread" << i << endl;
             exit(1);
         }
     }
     
     
-    run = true;
-    MFENCE();
+    run.store(true, std::memory_order_release);
     sleep(timeForRecord);
-    stop=true;
-    MFENCE();
+    stop.store(true, std::memory_order_relaxed);
     
     for (int i = 0; i < numThreads; i++) {
         pthread_join(threads[i], NULL);
@@ -285,6 +316,8 @@ void countRelaxed(int f){
     file << totalNumRelaxedActions/timeForRecord << endl;
     cout << "Throughput : " << totalNumRelaxedActions/timeForRecord << endl;
     cout << "Num of syncs : " << totalNumSyncActions/timeForRecord << endl;
+    printFlushes(totalNumRelaxedActions);
+    relaxedQueue.stats.print(cout);
     return;
     
 }
@@ -293,12 +326,1281 @@ void countRelaxed(int f){
 //==============================================End RelaxedQueue Test=====================================
 
 
+//===========================================Start Snapshot Test=======================================
+
+// The sum of every scanning thread, each on a cache line of its own.
+struct alignas(CACHE_LINE) SnapshotSum {
+    long sum;
+};
+SnapshotSum snapshotSums[MAX_THREADS];
+std::vector<RelaxedQueue<int>::Snapshot> snapshotParts;
+
+/* Sums the values of the given view. */
+long sumSnapshot(const RelaxedQueue<int>::Snapshot& snapshot) {
+    long sum = 0;
+    for (int value : snapshot) {
+        sum += value;
+    }
+    return sum;
+}
+
+void* startRoutineSnapshotScan(void* argsInput) {
+    int i = *(int*)argsInput;
+    snapshotSums[i].sum = sumSnapshot(snapshotParts[i]);
+    return 0;
+}
+
+/* Returns the time in microseconds. */
+long currentMicros() {
+    struct timeval time;
+    gettimeofday(&time, NULL);
+    return time.tv_sec * 1000000L + time.tv_usec;
+}
+
+/* Scans the durable snapshot of a queue of QUEUE_SIZE elements, first with
+ * one thread and then partitioned over all the threads, and times the split
+ * apart from the partitioned scan. Then scans the last
+ * snapshot over and over while the threads enqueue, dequeue and sync like in
+ * test 4, to show that neither side blocks the other.
+ */
+void countSnapshot() {
+
+    relaxedQueue.initialize();
+    relaxedQueue.sync(0);
+
+    RelaxedQueue<int>::Snapshot snapshot = relaxedQueue.snapshot();
+    long start = currentMicros();
+    long sum = sumSnapshot(snapshot);
+    long single = currentMicros() - start;
+
+    // Splitting is timed by itself, so the scans show only the scan
+    start = currentMicros();
+    snapshotParts = snapshot.partition(numThreads);
+    long split = currentMicros() - start;
+
+    start = currentMicros();
+    for (int i = 0; i < numThreads; i++) {
+        arguments[i] = i;
+        if(pthread_create(&threads[i], NULL, startRoutineSnapshotScan, (void*)&arguments[i])){
+            cout << "Error occurred when creating thread" << i << endl;
+            exit(1);
+        }
+    }
+    long partitionedSum = 0;
+    for (int i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], NULL);
+        partitionedSum += snapshotSums[i].sum;
+    }
+    long partitioned = currentMicros() - start;
+    if (partitionedSum != sum) {
+        cout << "Partitioned scan sum " << partitionedSum << " differs from " << sum << endl;
+    }
+    cout << "Scan of " << snapshot.size() << " values (us) : single " << single
+         << " partitioned " << partitioned << " split " << split << endl;
+
+    run = false;
+    stop = false;
+    totalNumRelaxedActions = 0;
+    totalNumSyncActions = 0;
+
+    for (int i = 0; i < numThreads; i++) {
+        arguments[i] = numThreads;
+        if(pthread_create(&threads[i], NULL, startRoutineRelaxedQueue, (void*)&arguments[i])){
+            cout << "Error occurred when creating thread" << i << endl;
+            exit(1);
+        }
+    }
+
+    long numScans = 0;
+    run.store(true, std::memory_order_release);
+    start = currentMicros();
+    while (currentMicros() - start < timeForRecord * 1000000L) {
+        sumSnapshot(relaxedQueue.snapshot());
+        numScans++;
+    }
+    stop.store(true, std::memory_order_relaxed);
+
+    for (int i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    file << "Snapshot " << single << " " << partitioned << " " << split << " " << totalNumRelaxedActions/timeForRecord << " " << numScans << endl;
+    cout << "Throughput while scanning : " << totalNumRelaxedActions/timeForRecord
+         << " Scans : " << numScans << endl;
+}
+
+//============================================End Snapshot Test========================================
+
+
+//============================================Start Arena Test=========================================
+
+// The size of the arenas of the arena test. Holds the nodes of a RelaxedQueue
+// and a LogQueue of QUEUE_SIZE elements.
+#define ARENA_TEST_SIZE ((size_t)512 * 1024 * 1024)
+
+/* Returns the kB of anonymous memory of the process that is backed by
+ * transparent huge pages.
+ */
+long anonHugePagesKB() {
+    ifstream smaps("/proc/self/smaps_rollup");
+    string key;
+    while (smaps >> key) {
+        if (key == "AnonHugePages:") {
+            long value;
+            smaps >> value;
+            return value;
+        }
+        smaps.ignore(numeric_limits<streamsize>::max(), '\n');
+    }
+    return 0;
+}
+
+/* Times the long walks over QUEUE_SIZE nodes that are allocated from the
+ * current nodeArena, or from the heap if it is null: filling a RelaxedQueue,
+ * the makeDurble walk of its first sync, draining it and the recovery walk
+ * of a full LogQueue. Prints the milliseconds of each.
+ */
+void timeLongWalks(const string& name) {
+    long hugeKB = anonHugePagesKB();
+    RelaxedQueue<int>* relaxed = new RelaxedQueue<int>();
+    long start = currentMicros();
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        relaxed->enq(i + 1);
+    }
+    long fill = currentMicros() - start;
+    start = currentMicros();
+    relaxed->sync(0);
+    long sync = currentMicros() - start;
+    start = currentMicros();
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        relaxed->deq();
+    }
+    long drain = currentMicros() - start;
+
+    LogQueue<int>* log = new LogQueue<int>();
+    log->initialize();
+    vector<LogQueue<int>::LogEntry*> detectableOps = log->logs.copy();
+    start = currentMicros();
+    log->recover(detectableOps);
+    long recovery = currentMicros() - start;
+    hugeKB = anonHugePagesKB() - hugeKB;
+
+    file << name << " : " << fill / 1000 << " " << sync / 1000 << " " << drain / 1000 << " " << recovery / 1000 << endl;
+    cout << name << " (ms) : enq " << fill / 1000 << " makeDurble " << sync / 1000
+         << " deq " << drain / 1000 << " LogQueue recovery " << recovery / 1000
+         << " (huge pages " << hugeKB << " kB)" << endl;
+    // The queues do not contain memory management, and their nodes go away
+    // with the arena.
+}
+
+/* Runs timeLongWalks on the heap and on private arenas of small and huge
+ * pages, and on a shared arena of huge pages like the one crash.cpp uses.
+ */
+void countArena() {
+    const char* pageNames[] = {"4KB pages", "hugetlb pages", "madvise huge pages"};
+    timeLongWalks("heap");
+    int options[] = {NodeArena::PRIVATE, NodeArena::PRIVATE | NodeArena::HUGE_PAGES,
+                     NodeArena::HUGE_PAGES};
+    for (int option : options) {
+        NodeArena arena(ARENA_TEST_SIZE, nullptr, option);
+        nodeArena = &arena;
+        NodeArena::forgetChunk();
+        timeLongWalks(string(option & NodeArena::PRIVATE ? "private " : "shared ") +
+                      "arena, " + pageNames[arena.pages]);
+        nodeArena = nullptr;
+        NodeArena::forgetChunk();
+    }
+}
+
+//=============================================End Arena Test==========================================
+
+
+//==========================================Start Bulk Load Test======================================
+
+/* Fills a new queue of type Q with QUEUE_SIZE values, once with enq and once
+ * with bulkLoad, and prints the milliseconds of each and, when compiled with
+ * -DCOUNT_FLUSHES, their flushes. The relaxed queue is synced after the
+ * enqueues, so both fills end with a durable queue.
+ */
+template <class Q> void timeFill(const string& name) {
+    vector<int> values(QUEUE_SIZE);
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        values[i] = i + 1;
+    }
+    Q* queue = new Q();
+    flushCount = 0;
+    long start = currentMicros();
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        queue->enq(values[i]);
+    }
+    if constexpr (is_same<Q, RelaxedQueue<int>>::value) {
+        queue->sync(0);
+    }
+    long enqTime = currentMicros() - start;
+#ifdef COUNT_FLUSHES
+    long enqFlushes = flushCount;
+#endif
+    // Only the queue goes, since the queues do not free their nodes
+    delete queue;
+
+    queue = new Q();
+    flushCount = 0;
+    start = currentMicros();
+    queue->bulkLoad(values.data(), QUEUE_SIZE);
+    long bulkTime = currentMicros() - start;
+#ifdef COUNT_FLUSHES
+    long bulkFlushes = flushCount;
+#endif
+
+    file << name << " " << enqTime / 1000 << " " << bulkTime / 1000 << endl;
+    cout << name << " (ms) : enq " << enqTime / 1000 << " bulkLoad " << bulkTime / 1000;
+#ifdef COUNT_FLUSHES
+    cout << " (flushes " << enqFlushes << " vs " << bulkFlushes << ")";
+#endif
+    cout << endl;
+    // The queues do not contain memory management.
+}
+
+void countBulkLoad() {
+    timeFill<MSQueue<int>>("MSQueue");
+    timeFill<DurableQueue<int>>("DurableQueue");
+    timeFill<LogQueue<int>>("LogQueue");
+    timeFill<RelaxedQueue<int>>("RelaxedQueue");
+}
+
+//===========================================End Bulk Load Test=======================================
+
+
+//============================================Start Stress Test========================================
+
+// The number of values every thread of the stress test enqueues.
+#define STRESS_OPS 100000
+// The relaxed queue is synced every SYNC_PERIOD operations of a thread.
+#define SYNC_PERIOD 1024
+
+template <class Q> Q* stressQueue;
+vector<int>* stressDequeued[MAX_THREADS];
+// The number of producers of the roles stress test, and how many of them
+// did not finish yet.
+int stressProducers = 1;
+std::atomic<int> stressProducing(0);
+
+/* A BlobQueue of int blobs with the operations of the other queues. */
+class StressBlobQueue {
+  public:
+    void enq(int value, int, int) {
+        queue.enq(&value, sizeof(int));
+    }
+    int deq(int threadID, int) {
+        BlobQueue<>::BlobView view = queue.deq(threadID);
+        if (!view) {
+            return INT_MIN;
+        }
+        int value;
+        memcpy(&value, view.data(), sizeof(int));
+        queue.release(threadID);
+        return value;
+    }
+  private:
+    BlobQueue<> queue;
+};
+
+/* Thread i enqueues i * STRESS_OPS + k for every k below STRESS_OPS, and
+ * dequeues after every enqueue. Keeps the values it dequeued.
+ */
+template <class Q> void* startRoutineStress(void* argsInput){
+
+    Q& queue = *stressQueue<Q>;
+    int i = *(int*)argsInput;
+    vector<int>* dequeued = stressDequeued[i];
+
+    while (!run.load(std::memory_order_acquire)) {  // busy-wait to start "simultaneously"
+        pthread_yield();
+    }
+
+    for (int k = 0; k < STRESS_OPS; k++) {
+        queue.enq(i * STRESS_OPS + k, i, 2 * k);
+        int value = queue.deq(i, 2 * k + 1);
+        if (value != INT_MIN) {
+            dequeued->push_back(value);
+        }
+        if constexpr (is_same<Q, RelaxedQueue<int>>::value) {
+            if (k % SYNC_PERIOD == 0) {
+                queue.sync(i);
+            }
+        }
+    }
+    return 0;
+}
+
+/* Threads below stressProducers enqueue i * STRESS_OPS + k for every k
+ * below STRESS_OPS, and the rest only dequeue until the producers finished
+ * and the queue is empty. For the queues with a single producer or a single
+ * consumer. Every consumer keeps the values it dequeued.
+ */
+template <class Q> void* startRoutineStressRoles(void* argsInput){
+
+    Q& queue = *stressQueue<Q>;
+    int i = *(int*)argsInput;
+    vector<int>* dequeued = stressDequeued[i];
+
+    while (!run.load(std::memory_order_acquire)) {  // busy-wait to start "simultaneously"
+        pthread_yield();
+    }
+
+    if (i < stressProducers) {
+        for (int k = 0; k < STRESS_OPS; k++) {
+            queue.enq(i * STRESS_OPS + k, i, k);
+        }
+        stressProducing.fetch_sub(1);
+    } else {
+        for (int k = 0; true; k++) {
+            // Read before the dequeue, so an empty queue after it is final
+            bool finished = stressProducing.load() == 0;
+            int value = queue.deq(i, k);
+            if (value != INT_MIN) {
+                dequeued->push_back(value);
+            } else if (finished) {
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Runs threadsNum threads of the given routine on stressQueue<Q>, drains the
+ * queue, and checks that every value of the first producers threads was
+ * dequeued exactly once. Returns the number of errors.
+ */
+template <class Q> long runStress(const string& name, void* (*routine)(void*),
+                                  int threadsNum, int producers){
+
+    run = false;
+
+    for (int i = 0; i < threadsNum; i++) {
+        arguments[i] = i;
+        stressDequeued[i] = new vector<int>();
+        stressDequeued[i]->reserve(STRESS_OPS);
+        if(pthread_create(&threads[i], NULL, routine, (void*)&arguments[i])){
+            cout << "Error occurred when creating thread" << i << endl;
+            exit(1);
+        }
+    }
+
+    run.store(true, std::memory_order_release);
+
+    for (int i = 0; i < threadsNum; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    vector<int> seen((long)producers * STRESS_OPS, 0);
+    long errors = 0;
+    for (int i = 0; i < threadsNum; i++) {
+        for (int value : *stressDequeued[i]) {
+            seen[value]++;
+        }
+        delete stressDequeued[i];
+    }
+    int value;
+    while ((value = stressQueue<Q>->deq(threadsNum, 0)) != INT_MIN) {
+        seen[value]++;
+    }
+    for (long v = 0; v < (long)seen.size(); v++) {
+        if (seen[v] != 1) {
+            errors++;
+        }
+    }
+    file << name << " " << errors << endl;
+    cout << name << " : " << (errors == 0 ? "OK" : "FAILED") << " (" << errors
+         << " values lost or duplicated)" << endl;
+    // The queues do not contain memory management.
+    return errors;
+}
+
+/* Runs the stress routine on a new queue of type Q, in which every thread
+ * enqueues and dequeues, and checks that every value was dequeued exactly
+ * once. Built with -fsanitize=thread it also checks the memory orderings of
+ * the hot paths. Returns the number of errors.
+ */
+template <class Q> long countStress(const string& name){
+    stressQueue<Q> = new Q();
+    return runStress<Q>(name, startRoutineStress<Q>, numThreads, numThreads);
+}
+
+/* Runs the roles stress routine on a new queue of type Q with the given
+ * numbers of producers and consumers. Returns the number of errors.
+ */
+template <class Q> long countStressRoles(const string& name, int producers,
+                                         int consumers){
+    stressQueue<Q> = new Q();
+    stressProducers = producers;
+    stressProducing = producers;
+    return runStress<Q>(name, startRoutineStressRoles<Q>, producers + consumers,
+                        producers);
+}
+
+/* Stresses the SPSC, MPSC and SPMC queues of the given policy, with one
+ * thread in the single role and the rest of the threads, at least one, in
+ * the other. Their producer enqueues and their consumer dequeues with plain
+ * stores.
+ */
+template <class Policy> long countStressCardinality(const string& name){
+    int others = numThreads > 2 ? numThreads - 1 : 1;
+    return countStressRoles<PersistentQueue<int, Policy, Clflush, SPSC>>(name + " SPSC", 1, 1) +
+           countStressRoles<PersistentQueue<int, Policy, Clflush, MPSC>>(name + " MPSC", others, 1) +
+           countStressRoles<PersistentQueue<int, Policy, Clflush, SPMC>>(name + " SPMC", 1, others);
+}
+
+long countStressAll(){
+    return countStress<MSQueue<int>>("MSQueue") +
+           countStress<DurableQueue<int>>("DurableQueue") +
+           countStress<LogQueue<int>>("LogQueue") +
+           countStress<RelaxedQueue<int>>("RelaxedQueue") +
+           countStress<StressBlobQueue>("BlobQueue") +
+           countStress<WaitFreeQueue<int>>("WaitFreeQueue") +
+           countStressCardinality<Volatile>("MSQueue") +
+           countStressCardinality<Durable>("DurableQueue") +
+           countStressCardinality<Detectable>("LogQueue");
+}
+
+//=============================================End Stress Test=========================================
+
+
+//============================================Start Msync Test=========================================
+
+#define MSYNC_BULK 10000
+#define MSYNC_ENQS 100
+#define MSYNC_DEQS 50
+
+/* Fills a queue that flushes with Msync in a private arena on a file, with
+ * bulkLoad and enq, and dequeues a few values. Msync writes the fenced pages
+ * of a private arena to the file, so the file then holds what a crash would
+ * leave on the disk. Maps the file again at the same address, recovers the
+ * queue and checks that it holds every value that was not dequeued, in
+ * order, and that the per-thread entry of the last dequeue survived and
+ * tells its value: the removedValues of the Durable queue, and the logs of
+ * the Log queue, recovered from their remapped logs.copy(). Returns the
+ * number of errors.
+ */
+template <class Q> long checkMsync(const char* name){
+    const char* path = "msync.test";
+    size_t arenaSize = 64L * 1024 * 1024;
+    NodeArena* arena = new NodeArena(arenaSize, path, NodeArena::PRIVATE);
+    nodeArena = arena;
+    NodeArena::forgetChunk();
+    Msync::attach(arena);
+
+    Q* queue = allocNode<Q>();
+    vector<int> values(MSYNC_BULK);
+    for (int i = 0; i < MSYNC_BULK; i++) {
+        values[i] = i + 1;
+    }
+    queue->bulkLoad(values.data(), MSYNC_BULK);
+    for (int i = 0; i < MSYNC_ENQS; i++) {
+        queue->enq(MSYNC_BULK + i + 1, 0, i);
+    }
+    for (int i = 0; i < MSYNC_DEQS; i++) {
+        queue->deq(0, MSYNC_ENQS + i);
+    }
+
+    // Drop the pages that were not fenced, and map what is in the file
+    char* base = arena->base;
+    Msync::attach(nullptr);
+    nodeArena = nullptr;
+    NodeArena::forgetChunk();
+    delete arena;
+    int fd = open(path, O_RDWR);
+    void* region = mmap(base, arenaSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_FIXED_NOREPLACE, fd, 0);
+    close(fd);
+    unlink(path);
+    if (region != base) {
+        cout << name << " : cannot map the file at the same address" << endl;
+        return 1;
+    }
+
+    long errors = 0;
+    if constexpr (is_same<Q, PersistentQueue<int, Detectable, Msync>>::value) {
+        vector<typename Q::LogEntry*> detectableOps = queue->logs.copy();
+        queue->recover(detectableOps);
+        typename Q::LogEntry* last = detectableOps.empty() ? nullptr : detectableOps[0];
+        if (!last || last->action != Q::remove ||
+            last->operationNum != MSYNC_ENQS + MSYNC_DEQS - 1 ||
+            !last->node || last->node->value != MSYNC_DEQS) {
+            cout << name << " : the last dequeue is not resolved" << endl;
+            errors++;
+        }
+    } else {
+        queue->recover();
+        typename Q::RemovedValue* last = queue->removedValues[0];
+        if (!last || !last->node.load() || last->node.load()->value != MSYNC_DEQS) {
+            cout << name << " : the last dequeue is not resolved" << endl;
+            errors++;
+        }
+    }
+    int expected = MSYNC_DEQS + 1;
+    for (int value = queue->deq(0, 0); value != INT_MIN; value = queue->deq(0, 0)) {
+        if (value != expected) {
+            errors++;
+        }
+        expected++;
+    }
+    if (expected != MSYNC_BULK + MSYNC_ENQS + 1) {
+        errors++;
+    }
+    munmap(base, arenaSize);
+    cout << name << " : " << expected - MSYNC_DEQS - 1 << " values after the remap, "
+         << errors << " errors" << endl;
+    file << "Msync " << name << " : " << errors << endl;
+    return errors;
+}
+
+/* Runs checkMsync on the Durable and the Log queue. */
+long checkMsyncAll(){
+    return checkMsync<PersistentQueue<int, Durable, Msync>>("Durable") +
+           checkMsync<PersistentQueue<int, Detectable, Msync>>("Log");
+}
+
+//=============================================End Msync Test==========================================
+
+
+//============================================Start Sweep Mode=========================================
+
+/* The options of a sweep. See sweep() for their meaning. */
+struct SweepOptions {
+    vector<string> queues = {"ms", "durable", "log", "relaxed"};
+    vector<long> threads = {1, 2, 4, 8};
+    vector<long> syncs = {10, 100, 1000};
+    vector<long> sizes = {5};
+    int warmup = 1;
+    int reps = 10;
+    int duration = 5;
+    size_t arenaMB = 16384;
+    string csv = "sweep.csv";
+    string json = "sweep.jsonl";
+    string baseline;
+    double tolerance = 5;
+};
+
+/* The throughput of the repetitions of one configuration. */
+struct SweepResult {
+    double mean = 0;
+    double stddev = 0;
+    double ciLow = 0;
+    double ciHigh = 0;
+};
+
+template <class Q> Q* sweepQueue;
+long sweepPeriod = 0;
+long totalNumSweepActions = 0;
+// Whether the last run ran out of its arena.
+std::atomic<bool> sweepExhausted(false);
+
+/* Like the routines of tests 1-4: every thread enqueues and dequeues, and
+ * with the relaxed queue syncs after every sweepPeriod of its operations. A
+ * thread that runs out of the arena stops the run for all the threads.
+ */
+template <class Q> void* startRoutineSweep(void* argsInput){
+
+    long numMyOps = 0;
+    long sinceSync = 0;
+
+    Q& queue = *sweepQueue<Q>;
+    int i = *(int*)argsInput;
+
+    while (!run.load(std::memory_order_acquire)) {  // busy-wait to start "simultaneously"
+        pthread_yield();
+    }
+
+    try {
+        while (!stop.load(std::memory_order_relaxed)) {
+            queue.enq(i, i, numMyOps);
+            queue.deq(i, numMyOps + 1);
+            numMyOps += 2;
+            if constexpr (is_same<Q, RelaxedQueue<int>>::value) {
+                sinceSync += 2;
+                if (sweepPeriod > 0 && sinceSync >= sweepPeriod) {
+                    queue.sync(i);
+                    sinceSync = 0;
+                }
+            }
+        }
+    } catch (const std::bad_alloc&) {
+        sweepExhausted = true;
+        stop = true;
+    }
+    ADD(&totalNumSweepActions, numMyOps);
+    return 0;
+}
+
+/* Runs the threads on a new queue of type Q that starts with size values, for
+ * the given number of seconds, and returns the operations per second. Every
+ * run allocates from an arena of its own, which is unmapped after the run,
+ * since the queues never free their nodes. If the arena runs out, the run
+ * ends early and sets sweepExhausted, and its result should be dropped.
+ */
+template <class Q> double sweepRun(int threadsNum, long size, int seconds,
+                                   size_t arenaBytes){
+
+    NodeArena arena(arenaBytes, nullptr, NodeArena::PRIVATE);
+    nodeArena = &arena;
+    NodeArena::forgetChunk();
+    sweepExhausted = false;
+
+    try {
+        sweepQueue<Q> = allocNode<Q>();
+        vector<int> values(size);
+        for (long i = 0; i < size; i++) {
+            values[i] = i + 1;
+        }
+        sweepQueue<Q>->bulkLoad(values.data(), size);
+    } catch (const std::bad_alloc&) {
+        sweepExhausted = true;
+        nodeArena = nullptr;
+        NodeArena::forgetChunk();
+        return 0;
+    }
+
+    run = false;
+    stop = false;
+    totalNumSweepActions = 0;
+
+    for (int i = 0; i < threadsNum; i++) {
+        arguments[i] = i;
+        if(pthread_create(&threads[i], NULL, startRoutineSweep<Q>, (void*)&arguments[i])){
+            cout << "Error occurred when creating thread" << i << endl;
+            exit(1);
+        }
+    }
+
+    long start = currentMicros();
+    run.store(true, std::memory_order_release);
+    while (!stop.load(std::memory_order_relaxed) &&
+           currentMicros() - start < seconds * 1000000L) {
+        usleep(1000);
+    }
+    stop.store(true, std::memory_order_relaxed);
+    long elapsed = currentMicros() - start;
+
+    for (int i = 0; i < threadsNum; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    nodeArena = nullptr;
+    NodeArena::forgetChunk();
+    return totalNumSweepActions * 1e6 / elapsed;
+}
+
+/* The two-sided 95% quantile of Student's t distribution with the given
+ * degrees of freedom.
+ */
+double tQuantile95(int freedom) {
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447,
+                                   2.365, 2.306, 2.262, 2.228, 2.201, 2.179,
+                                   2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+                                   2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+                                   2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (freedom < 1) {
+        return 0;
+    }
+    return freedom <= 30 ? table[freedom - 1] : 1.960;
+}
+
+/* Returns the mean, the sample standard deviation and the 95% confidence
+ * interval of the mean of the given runs.
+ */
+SweepResult summarize(const vector<double>& runs) {
+    SweepResult result;
+    int n = runs.size();
+    for (double value : runs) {
+        result.mean += value / n;
+    }
+    if (n > 1) {
+        double squares = 0;
+        for (double value : runs) {
+            squares += (value - result.mean) * (value - result.mean);
+        }
+        result.stddev = sqrt(squares / (n - 1));
+    }
+    double halfWidth = tQuantile95(n - 1) * result.stddev / sqrt((double)n);
+    result.ciLow = result.mean - halfWidth;
+    result.ciHigh = result.mean + halfWidth;
+    return result;
+}
+
+typedef std::tuple<string, long, long, long> SweepKey;  // queue, threads, sync, size
+
+/* Reads the results of a previous sweep from its CSV file. */
+map<SweepKey, SweepResult> readBaseline(const string& path) {
+    map<SweepKey, SweepResult> baseline;
+    ifstream in(path);
+    if (!in) {
+        cout << "Cannot read the baseline " << path << endl;
+        exit(1);
+    }
+    string line;
+    getline(in, line);  // The header
+    while (getline(in, line)) {
+        stringstream fields(line);
+        string queue, cell;
+        vector<double> numbers;
+        getline(fields, queue, ',');
+        while (getline(fields, cell, ',')) {
+            numbers.push_back(atof(cell.c_str()));
+        }
+        if (numbers.size() < 8) {
+            continue;
+        }
+        SweepResult result;
+        result.mean = numbers[4];
+        result.stddev = numbers[5];
+        result.ciLow = numbers[6];
+        result.ciHigh = numbers[7];
+        baseline[SweepKey(queue, numbers[0], numbers[1], numbers[2])] = result;
+    }
+    return baseline;
+}
+
+/* Runs every configuration of the given queue: a warm-up run that is not
+ * recorded and then the repetitions. Writes a CSV row and a JSON line for
+ * each, and returns the number of configurations that regressed against the
+ * baseline. A configuration that runs out of the arena stops at that run. It
+ * gets no CSV row, and its JSON line is marked truncated and holds only the
+ * runs that finished.
+ */
+template <class Q> int sweepQueueConfigs(const string& name, const SweepOptions& options,
+                                         const vector<long>& syncs,
+                                         const map<SweepKey, SweepResult>& baseline,
+                                         ofstream& csv, ofstream& json){
+    int regressions = 0;
+    for (long threadsNum : options.threads) {
+        for (long sync : syncs) {
+            for (long size : options.sizes) {
+                // Like test 4, every thread syncs after sync of its own operations
+                sweepPeriod = sync;
+                size_t arenaBytes = options.arenaMB * 1024 * 1024;
+                if (options.warmup > 0) {
+                    sweepRun<Q>(threadsNum, size, options.warmup, arenaBytes);
+                }
+                vector<double> runs;
+                for (int r = 0; r < options.reps && !sweepExhausted; r++) {
+                    double throughput = sweepRun<Q>(threadsNum, size, options.duration,
+                                                    arenaBytes);
+                    if (!sweepExhausted) {
+                        runs.push_back(throughput);
+                    }
+                }
+                if (sweepExhausted) {
+                    json << fixed << setprecision(1) << "{\"queue\": \"" << name
+                         << "\", \"threads\": " << threadsNum << ", \"sync\": " << sync
+                         << ", \"size\": " << size << ", \"reps\": " << runs.size()
+                         << ", \"truncated\": true, \"runs\": [";
+                    for (size_t r = 0; r < runs.size(); r++) {
+                        json << (r > 0 ? ", " : "") << runs[r];
+                    }
+                    json << "]}" << endl;
+                    cout << left << setw(9) << name << right << " threads " << setw(3)
+                         << threadsNum << " sync " << setw(6) << sync << " size "
+                         << setw(8) << size << " : TRUNCATED, the " << options.arenaMB
+                         << "MB arena ran out after " << runs.size() << " runs" << endl;
+                    sweepExhausted = false;
+                    continue;
+                }
+                SweepResult result = summarize(runs);
+
+                csv << fixed << setprecision(1) << name << "," << threadsNum << ","
+                    << sync << "," << size << "," << options.reps << ","
+                    << result.mean << "," << result.stddev << ","
+                    << result.ciLow << "," << result.ciHigh << endl;
+                json << fixed << setprecision(1) << "{\"queue\": \"" << name
+                     << "\", \"threads\": " << threadsNum << ", \"sync\": " << sync
+                     << ", \"size\": " << size << ", \"reps\": " << options.reps
+                     << ", \"mean\": " << result.mean << ", \"stddev\": "
+                     << result.stddev << ", \"ci_low\": " << result.ciLow
+                     << ", \"ci_high\": " << result.ciHigh
+                     << ", \"truncated\": false, \"runs\": [";
+                for (size_t r = 0; r < runs.size(); r++) {
+                    json << (r > 0 ? ", " : "") << runs[r];
+                }
+                json << "]}" << endl;
+
+                cout << fixed << setprecision(0) << left << setw(9) << name << right
+                     << " threads " << setw(3) << threadsNum << " sync " << setw(6)
+                     << sync << " size " << setw(8) << size << " : " << setw(12)
+                     << result.mean << " +- " << (result.ciHigh - result.mean);
+                auto base = baseline.find(SweepKey(name, threadsNum, sync, size));
+                if (base != baseline.end()) {
+                    double change = 100 * (result.mean / base->second.mean - 1);
+                    cout << " (" << showpos << setprecision(1) << change << noshowpos
+                         << "% vs baseline)";
+                    // A regression is a drop beyond the tolerance that the
+                    // confidence intervals do not explain
+                    if (change < -options.tolerance &&
+                        result.ciHigh < base->second.ciLow) {
+                        cout << " REGRESSION";
+                        regressions++;
+                    }
+                }
+                cout << endl;
+            }
+        }
+    }
+    return regressions;
+}
+
+/* Splits a comma separated list of numbers. */
+vector<long> splitNumbers(const string& list) {
+    vector<long> numbers;
+    stringstream stream(list);
+    string item;
+    while (getline(stream, item, ',')) {
+        numbers.push_back(atol(item.c_str()));
+    }
+    return numbers;
+}
+
+/* The sweep mode, which replaces a process per run. Usage:
+ * ./exe sweep [--queues ms,durable,log,relaxed] [--threads 1,2,4,8]
+ *             [--sync 10,100,1000] [--sizes 5] [--warmup 1] [--reps 10]
+ *             [--duration 5] [--arena 16384] [--csv sweep.csv]
+ *             [--json sweep.jsonl] [--baseline old.csv] [--tolerance 5]
+ * Runs every queue with every number of threads and initial queue size, and
+ * the relaxed queue also with every sync frequency: every thread calls sync()
+ * after that many of its own operations, like test 4. Every configuration has a
+ * warm-up run of --warmup seconds and --reps runs of --duration seconds.
+ * Appends a row per configuration to the CSV file (queue, threads, sync,
+ * size, reps, mean, stddev, ci_low, ci_high, in operations per second, with
+ * the 95% confidence interval of the mean), and a JSON object with the same
+ * fields and the runs to the JSON lines file. The other queues have a sync
+ * of 0. With --baseline, every configuration is compared with its row in the
+ * CSV file of an earlier sweep, and is flagged as a regression if its mean
+ * is lower by more than --tolerance percent and its confidence interval is
+ * below the baseline one. --arena is the size in MB of the address space of
+ * the arena of each run. A configuration whose run fills the arena is
+ * reported as truncated and skipped. Returns 2 if there were regressions.
+ */
+int sweep(int argc, char* argv[]){
+    SweepOptions options;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        string value = argv[i + 1];
+        if (option == "--queues") {
+            options.queues.clear();
+            stringstream stream(value);
+            string item;
+            while (getline(stream, item, ',')) {
+                options.queues.push_back(item);
+            }
+        } else if (option == "--threads") {
+            options.threads = splitNumbers(value);
+        } else if (option == "--sync") {
+            options.syncs = splitNumbers(value);
+        } else if (option == "--sizes") {
+            options.sizes = splitNumbers(value);
+        } else if (option == "--warmup") {
+            options.warmup = atoi(value.c_str());
+        } else if (option == "--reps") {
+            options.reps = atoi(value.c_str());
+        } else if (option == "--duration") {
+            options.duration = atoi(value.c_str());
+        } else if (option == "--arena") {
+            options.arenaMB = atol(value.c_str());
+        } else if (option == "--csv") {
+            options.csv = value;
+        } else if (option == "--json") {
+            options.json = value;
+        } else if (option == "--baseline") {
+            options.baseline = value;
+        } else if (option == "--tolerance") {
+            options.tolerance = atof(value.c_str());
+        } else {
+            cout << "Unknown option " << option << endl;
+            return 1;
+        }
+    }
+    for (long threadsNum : options.threads) {
+        if (threadsNum < 1 || threadsNum >= MAX_THREADS) {
+            cout << "The number of threads must be 1-" << MAX_THREADS - 1 << endl;
+            return 1;
+        }
+    }
+
+    map<SweepKey, SweepResult> baseline;
+    if (!options.baseline.empty()) {
+        baseline = readBaseline(options.baseline);
+    }
+    bool newCsv = !ifstream(options.csv).good();
+    ofstream csv(options.csv, ofstream::app);
+    ofstream json(options.json, ofstream::app);
+    if (newCsv) {
+        csv << "queue,threads,sync,size,reps,mean,stddev,ci_low,ci_high" << endl;
+    }
+
+    int regressions = 0;
+    vector<long> noSync(1, 0);
+    for (const string& name : options.queues) {
+        if (name == "ms") {
+            regressions += sweepQueueConfigs<MSQueue<int>>(name, options, noSync,
+                                                           baseline, csv, json);
+        } else if (name == "durable") {
+            regressions += sweepQueueConfigs<DurableQueue<int>>(name, options, noSync,
+                                                                baseline, csv, json);
+        } else if (name == "log") {
+            regressions += sweepQueueConfigs<LogQueue<int>>(name, options, noSync,
+                                                            baseline, csv, json);
+        } else if (name == "relaxed") {
+            regressions += sweepQueueConfigs<RelaxedQueue<int>>(name, options,
+                                                                options.syncs,
+                                                                baseline, csv, json);
+        } else {
+            cout << "Unknown queue " << name << endl;
+            return 1;
+        }
+    }
+    if (!baseline.empty()) {
+        cout << regressions << " regressions" << endl;
+    }
+    return regressions > 0 ? 2 : 0;
+}
+
+//=============================================End Sweep Mode==========================================
+
+
+//==========================================Start Cardinality Test=====================================
+
+// The number of elements the producers of the cardinality test may be ahead
+// of the consumers. Keeps the queue, and the nodes that are never freed,
+// bounded when the producers are faster.
+#define MAX_BACKLOG QUEUE_SIZE
+#define BACKLOG_BATCH 1024
+
+int numProducers = 1;
+long totalNumEnqueued = 0;
+long totalNumDequeued = 0;
+long totalNumRolesActions = 0;
+
+template <class Q> Q* rolesQueue;
+
+/* Threads below numProducers only enqueue and the rest only dequeue. Only
+ * the successful dequeues are counted.
+ */
+template <class Q> void* startRoutineRoles(void* argsInput){
+
+    long numMyOps = 0;
+
+    Q& queue = *rolesQueue<Q>;
+    int i = *(int*)argsInput;
+
+    while (!run.load(std::memory_order_acquire)) {  // busy-wait to start "simultaneously"
+        pthread_yield();
+    }
+
+    if (i < numProducers) {
+        while (!stop.load(std::memory_order_relaxed)) {
+            queue.enq(i, i, numMyOps);
+            numMyOps++;
+            if (numMyOps % BACKLOG_BATCH == 0) {
+                ADD(&totalNumEnqueued, BACKLOG_BATCH);
+                while (!stop.load(std::memory_order_relaxed) && totalNumEnqueued - totalNumDequeued > MAX_BACKLOG) {
+                    pthread_yield();
+                }
+            }
+        }
+    } else {
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (queue.deq(i, numMyOps) != INT_MIN) {
+                numMyOps++;
+                if (numMyOps % BACKLOG_BATCH == 0) {
+                    ADD(&totalNumDequeued, BACKLOG_BATCH);
+                }
+            }
+        }
+    }
+    ADD(&totalNumRolesActions, numMyOps);
+    return 0;
+}
+
+/* Runs producers and consumers on a new queue of type Q and returns the
+ * number of operations per second.
+ */
+template <class Q> long countRoles(int producers, int consumers){
+
+    rolesQueue<Q> = new Q();  // Starts empty, like a pipeline
+
+    run = false;
+    stop = false;
+
+    numProducers = producers;
+    totalNumEnqueued = 0;
+    totalNumDequeued = 0;
+    totalNumRolesActions = 0;
+
+    for (int i = 0; i < producers + consumers; i++) {
+        arguments[i] = i;
+        if(pthread_create(&threads[i], NULL, startRoutineRoles<Q>, (void*)&arguments[i])){
+            cout << "Error occurred when creating thread" << i << endl;
+            exit(1);
+        }
+    }
+
+    run.store(true, std::memory_order_release);
+    sleep(timeForRecord);
+    stop.store(true, std::memory_order_relaxed);
+
+    for (int i = 0; i < producers + consumers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    // The queues do not contain memory management, so the queue and its
+    // nodes are not freed.
+    return totalNumRolesActions/timeForRecord;
+}
+
+/* Compares the single producer and single consumer specializations of the
+ * queue with the given policy with its MPMC version in the same roles. The
+ * threads that are not the single producer or consumer take the other role.
+ */
+template <class Policy> void countCardinality(){
+
+    int others = numThreads > 2 ? numThreads - 1 : 1;
+    long mpmc, single;
+
+    mpmc = countRoles<PersistentQueue<int, Policy, Clflush, MPMC> >(1, 1);
+    single = countRoles<PersistentQueue<int, Policy, Clflush, SPSC> >(1, 1);
+    file << "SPSC 1 1 : " << mpmc << " " << single << endl;
+    cout << "SPSC producers 1 consumers 1 : MPMC " << mpmc << " SPSC " << single << endl;
+
+    mpmc = countRoles<PersistentQueue<int, Policy, Clflush, MPMC> >(others, 1);
+    single = countRoles<PersistentQueue<int, Policy, Clflush, MPSC> >(others, 1);
+    file << "MPSC " << others << " 1 : " << mpmc << " " << single << endl;
+    cout << "MPSC producers " << others << " consumers 1 : MPMC " << mpmc << " MPSC " << single << endl;
+
+    mpmc = countRoles<PersistentQueue<int, Policy, Clflush, MPMC> >(1, others);
+    single = countRoles<PersistentQueue<int, Policy, Clflush, SPMC> >(1, others);
+    file << "SPMC 1 " << others << " : " << mpmc << " " << single << endl;
+    cout << "SPMC producers 1 consumers " << others << " : MPMC " << mpmc << " SPMC " << single << endl;
+}
+
+//===========================================End Cardinality Test======================================
+
+
+//===========================================Start Fan-out Test========================================
+
+// The number of values a consumer of the log reads before every commit.
+#define FANOUT_BATCH 64
+
+int numConsumers = 1;
+PersistentLog<int>* fanoutLog;
+DurableQueue<int>* fanoutQueues;
+long totalNumDelivered = 0;
+
+/* Thread 0 produces. Blocks it while the consumers are on average more than
+ * MAX_BACKLOG values behind.
+ */
+void throttleProducer(long numMyOps) {
+    if (numMyOps % BACKLOG_BATCH == 0) {
+        ADD(&totalNumEnqueued, BACKLOG_BATCH);
+        while (!stop.load(std::memory_order_relaxed) && totalNumEnqueued - totalNumDequeued / numConsumers > MAX_BACKLOG) {
+            pthread_yield();
+        }
+    }
+}
+
+/* Reports the values a consumer delivered in whole BACKLOG_BATCHes. */
+void reportConsumed(long numMyOps, long& reported) {
+    while (numMyOps - reported >= BACKLOG_BATCH) {
+        ADD(&totalNumDequeued, BACKLOG_BATCH);
+        reported += BACKLOG_BATCH;
+    }
+}
+
+/* Thread 0 appends to the log, and every other thread is a consumer that
+ * reads batches of FANOUT_BATCH values and commits after each of them.
+ */
+void* startRoutineFanoutLog(void* argsInput){
+
+    long numMyOps = 0, reported = 0;
+    int i = *(int*)argsInput;
+    int values[FANOUT_BATCH];
+
+    while (!run.load(std::memory_order_acquire)) {  // busy-wait to start "simultaneously"
+        pthread_yield();
+    }
+
+    if (i == 0) {
+        while (!stop.load(std::memory_order_relaxed)) {
+            fanoutLog->append(i, i);
+            numMyOps++;
+            throttleProducer(numMyOps);
+        }
+    } else {
+        while (!stop.load(std::memory_order_relaxed)) {
+            int numRead = fanoutLog->read(i - 1, values, FANOUT_BATCH);
+            if (numRead > 0) {
+                fanoutLog->commit(i - 1);
+                numMyOps += numRead;
+                reportConsumed(numMyOps, reported);
+            }
+        }
+        ADD(&totalNumDelivered, numMyOps);
+    }
+    ADD(&totalNumFlushes, flushCount);
+    return 0;
+}
+
+/* Thread 0 enqueues every value into the queue of every consumer, and every
+ * other thread dequeues from its own queue.
+ */
+void* startRoutineFanoutQueues(void* argsInput){
+
+    long numMyOps = 0, reported = 0;
+    int i = *(int*)argsInput;
+
+    while (!run.load(std::memory_order_acquire)) {  // busy-wait to start "simultaneously"
+        pthread_yield();
+    }
+
+    if (i == 0) {
+        while (!stop.load(std::memory_order_relaxed)) {
+            for (int j = 0; j < numConsumers; j++) {
+                fanoutQueues[j].enq(i, i);
+            }
+            numMyOps++;
+            throttleProducer(numMyOps);
+        }
+    } else {
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (fanoutQueues[i - 1].deq(i) != INT_MIN) {
+                numMyOps++;
+                reportConsumed(numMyOps, reported);
+            }
+        }
+        ADD(&totalNumDelivered, numMyOps);
+    }
+    ADD(&totalNumFlushes, flushCount);
+    return 0;
+}
+
+/* Runs one producer and numConsumers consumers with the given routine and
+ * returns the number of values delivered to the consumers per second.
+ */
+long countFanoutRun(void* (*routine)(void*)){
+
+    run = false;
+    stop = false;
+
+    totalNumEnqueued = 0;
+    totalNumDequeued = 0;
+    totalNumDelivered = 0;
+    totalNumFlushes = 0;
+
+    for (int i = 0; i < numConsumers + 1; i++) {
+        arguments[i] = i;
+        if(pthread_create(&threads[i], NULL, routine, (void*)&arguments[i])){
+            cout << "Error occurred when creating thread" << i << endl;
+            exit(1);
+        }
+    }
+
+    run.store(true, std::memory_order_release);
+    sleep(timeForRecord);
+    stop.store(true, std::memory_order_relaxed);
+
+    for (int i = 0; i < numConsumers + 1; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    printFlushes(totalNumDelivered);
+    return totalNumDelivered/timeForRecord;
+}
+
+/* Appends three segments of values to a log with one consumer, which reads
+ * and commits one and a half of them, so the first segment is freed. A
+ * consumer that registers from the start then has to read every value from
+ * the second segment on, in order. Returns the number of errors.
+ */
+long checkFanoutFromStart(){
+    typedef PersistentLog<int> Log;
+    Log* log = new Log();
+    int first = log->registerConsumer();
+    for (int i = 1; i <= 3 * Log::SEGMENT_SIZE; i++) {
+        log->append(i, 0);
+    }
+    int values[FANOUT_BATCH];
+    for (long read = 0; read < Log::SEGMENT_SIZE + Log::SEGMENT_SIZE / 2;) {
+        read += log->read(first, values, FANOUT_BATCH);
+        log->commit(first);
+    }
+    int late = log->registerConsumer(true);
+    long errors = 0;
+    int expected = Log::SEGMENT_SIZE;
+    for (int numRead = log->read(late, values, FANOUT_BATCH); numRead > 0;
+         numRead = log->read(late, values, FANOUT_BATCH)) {
+        for (int i = 0; i < numRead; i++) {
+            if (values[i] != expected++) {
+                errors++;
+            }
+        }
+    }
+    if (expected != 3 * Log::SEGMENT_SIZE + 1) {
+        errors++;
+    }
+    cout << "From-start consumer after a reclaim : " << (errors == 0 ? "OK" : "FAILED")
+         << " (" << errors << " errors)" << endl;
+    file << "Fan-out from start " << errors << endl;
+    // The log does not contain memory management.
+    return errors;
+}
+
+/* Compares delivering every value to all the consumers through one durable
+ * queue per consumer with one PersistentLog that all of them read, and then
+ * checks a consumer that registers from the start after a reclaim. Returns
+ * the number of errors of the check.
+ */
+long countFanout(){
+
+    numConsumers = numThreads > 2 ? numThreads - 1 : 1;
+
+    fanoutQueues = new DurableQueue<int>[numConsumers];
+    long queues = countFanoutRun(startRoutineFanoutQueues);
+
+    fanoutLog = new PersistentLog<int>();
+    for (int i = 0; i < numConsumers; i++) {
+        fanoutLog->registerConsumer();
+    }
+    long log = countFanoutRun(startRoutineFanoutLog);
+
+    file << "Fan-out " << numConsumers << " : " << queues << " " << log << endl;
+    cout << "Fan-out consumers " << numConsumers << " : Queues " << queues << " Log " << log << endl;
+    return checkFanoutFromStart();
+}
+
+//============================================End Fan-out Test=========================================
+
+
 //====================================================================================================
 
 /* The main can run all the queue versions. It requires the following command line parameters:
  * 1 - The test num. 1 is the original Michael and Scott's lock free queue.
  *     2 is the Durable queue. 3 is the Log queue. 4 is the relaxed queue which is also
  *     optimizaed for big sizes of queues.
+ *     5 and 6 compare the single producer and single consumer versions of the MS queue
+ *     and the Durable queue with their MPMC versions, with one thread in the single role
+ *     and the rest of the threads in the other.
+ *     7 delivers every value of one producer to all the other threads, once through a
+ *     Durable queue per consumer and once through a PersistentLog that all of them read,
+ *     and checks that a consumer that registers from the start after a reclaim reads on
+ *     from the oldest value that was not freed.
+ *     8 scans the durable snapshot of the relaxed queue, alone and partitioned over the threads,
+ *     and then while the threads run the relaxed queue.
+ *     9 times the long walks over QUEUE_SIZE nodes on the heap and in node arenas of small
+ *     and huge pages.
+ *     10 fills each queue with QUEUE_SIZE values, once with enq and once with bulkLoad.
+ *     11 runs enqueues and dequeues of unique values on every queue, BlobQueue and WaitFreeQueue included, and
+ *     checks that each value is dequeued exactly once. The SPSC, MPSC and SPMC queues run with one thread in the
+ *     single role and the others in the other. Build it with -fsanitize=thread to check the memory orderings.
+ *     12 fills the Durable and Log queues with the Msync flush in a private arena on a file, maps
+ *     the file again and checks that every value that was fenced is in it.
+ *     "sweep" instead of a test number runs all the configurations of tests 1-4 in this process,
+ *     with repetitions and statistics. See sweep() for its options.
  * 2 - the number of the running threads.
  * 3 - the frequency of calling to sync for every thread. It is related only to test 4. All the
  *     rest should get the default number of 1, but they do not use it anyway.
@@ -309,6 +1611,10 @@ void countRelaxed(int f){
  */ 
 int main(int argc, char* argv[]){
 
+    if (argc > 1 && string(argv[1]) == "sweep") {
+        return sweep(argc, argv);
+    }
+
     file.open("results.txt", ofstream::app);
 
     int testNum = atoi(argv[1]);
@@ -355,7 +1661,63 @@ int main(int argc, char* argv[]){
             cout << "Test Relaxed - Threads num: " << numThreads << " Frequency: "<< numThreads * frequency << " Size: " << size << endl;
         }
         countRelaxed(numThreads * frequency);
+    } else if (testNum == 5 || testNum == 6) {
+        if (iteration == 1) {
+            file << "Test Cardinality " << (testNum == 5 ? "MSQueue" : "Durable") << " - Threads num: " << numThreads << endl;
+            cout << "Test Cardinality " << (testNum == 5 ? "MSQueue" : "Durable") << " - Threads num: " << numThreads << endl;
+        }
+        if (testNum == 5) {
+            countCardinality<Volatile>();
+        } else {
+            countCardinality<Durable>();
+        }
+    } else if (testNum == 7) {
+        if (iteration == 1) {
+            file << "Test Fan-out - Threads num: " << numThreads << endl;
+            cout << "Test Fan-out - Threads num: " << numThreads << endl;
+        }
+        if (countFanout() != 0) {
+            return 1;
+        }
+    } else if (testNum == 8) {
+        if (iteration == 1) {
+            file << "Test Snapshot - Threads num: " << numThreads << endl;
+            cout << "Test Snapshot - Threads num: " << numThreads << endl;
+        }
+        countSnapshot();
+    } else if (testNum == 9) {
+        if (iteration == 1) {
+            file << "Test Arena - Threads num: " << numThreads << endl;
+            cout << "Test Arena - Threads num: " << numThreads << endl;
+        }
+        countArena();
+    } else if (testNum == 10) {
+        if (iteration == 1) {
+            file << "Test Bulk Load - Threads num: " << numThreads << endl;
+            cout << "Test Bulk Load - Threads num: " << numThreads << endl;
+        }
+        countBulkLoad();
+    } else if (testNum == 11) {
+        if (iteration == 1) {
+            file << "Test Stress - Threads num: " << numThreads << endl;
+            cout << "Test Stress - Threads num: " << numThreads << endl;
+        }
+        if (countStressAll() != 0) {
+            return 1;
+        }
+    } else if (testNum == 12) {
+        if (iteration == 1) {
+            file << "Test Msync - Threads num: " << numThreads << endl;
+            cout << "Test Msync - Threads num: " << numThreads << endl;
+        }
+        if (checkMsyncAll() != 0) {
+            return 1;
+        }
     }
+#ifdef PERSIST_TRACE
+    // Analyze with: python analyzeTrace.py trace.txt
+    dumpTrace("trace.txt");
+#endif
     return 0;
 }
 
@@ -1,34 +1,28 @@
 #!/usr/bin/python
-import subprocess
+import csv
 import matplotlib as mpl
 from matplotlib import pyplot as plt
 from matplotlib import ticker
-import numpy as np
-import re
 import sys
 
-def plot_speeds(speeds, errors, dataset):
-    average_speeds = speeds
-    indexes = [1, 2, 3, 4, 5, 6, 7, 8]
+def plot_speeds(speeds, errors, threads):
     MS = 12
     LW = 4
-    
-    
+
+
     #-------------------------------------------AllQueues------------------------------------------------------------#
     plt.figure(2)
-    
-    if("Test MSQueue " in average_speeds):
-        plt.plot(indexes, average_speeds["Test MSQueue "],'-o', label="$MSQ$", markersize=MS, linewidth=3, c="black")
-    if("Test Durable " in average_speeds):
-        plt.plot(indexes, average_speeds["Test Durable "],'-*',label="$Durable$", markersize=MS,  linewidth=3, c="blue")
-    if("Test Log " in average_speeds):
-        plt.plot(indexes, average_speeds["Test Log "],'-^', label="$Log$", markersize=MS, linewidth=3, c="red")
-    if("Test Relaxed 0 size 1000000\n" in average_speeds):
-        plt.plot(indexes, average_speeds["Test Relaxed 0 size 5\n"],"-D",label="$Relaxed\ " "10\ " "size\ " "1000000$", markersize=MS, linewidth=LW, c="gold")
-    if("Test Relaxed 00 size 1000000\n" in average_speeds):
-        plt.plot(indexes, average_speeds["Test Relaxed 00 size 5\n"],"-v",label="$Relaxed\ " "100\ " "size\ " "1000000$", markersize=MS, linewidth=LW, c="green")
-    if("Test Relaxed 000 size 1000000\n" in average_speeds):
-        plt.plot(indexes, average_speeds["Test Relaxed 000 size 5\n"],"-H",label="$Relaxed\ " "1000\ " "size\ " "1000000$", markersize=MS, linewidth=LW, c="purple")
+
+    lines = [(("ms", 0), '-o', "$MSQ$", 3, "black"),
+             (("durable", 0), '-*', "$Durable$", 3, "blue"),
+             (("log", 0), '-^', "$Log$", 3, "red"),
+             (("relaxed", 10), "-D", "$Relaxed\ " "10$", LW, "gold"),
+             (("relaxed", 100), "-v", "$Relaxed\ " "100$", LW, "green"),
+             (("relaxed", 1000), "-H", "$Relaxed\ " "1000$", LW, "purple")]
+    for key, marker, label, width, color in lines:
+        if (key in speeds):
+            plt.errorbar(threads[key], speeds[key], yerr=errors[key], fmt=marker, label=label,
+                         markersize=MS, linewidth=width, c=color, capsize=4)
 
 
     ticks,labels = plt.xticks()
@@ -46,61 +40,25 @@ def plot_speeds(speeds, errors, dataset):
     plt.clf()
 
 
-
-csvFiles = dict()
-csvFiles['Results'] = sys.argv[1]
+# Reads the CSV file of a sweep (see run.sh) and plots the queues with the
+# initial size given as the second argument (5 by default). The error bars
+# are the 95% confidence intervals of the means.
+size = sys.argv[2] if len(sys.argv) > 2 else "5"
 
 speeds = dict()
 errors = dict()
-
-
-for dataset in csvFiles:
-    lines = open(csvFiles[dataset]).readlines()
-    speeds[dataset] = dict()
-    errors[dataset] = dict()
-    sumT = 0
-    lineNumber = 0
-    alg = ""
-    f = ""
-    size = ""
-    i = 0
-    t_n_1 = 2.262 # t statistic for 9 degrees of freedom @ 0.95 confidence two tail
-    for line in lines:
-        if (lineNumber % 11 == 0):
-            sumT = 0
-            lineSplitted = line.split('-')
-            alg = lineSplitted[0]
-            values=[]
-            i = 0
-            if (alg == "Test Relaxed "):
-                f = lineSplitted[1].split(':')[2]
-                size = lineSplitted[1].split(':')[3]
-                f = f.split(' ')[1]
-                f = f[1:]
-                size = size[1:]
-                alg = alg + f + " size " + size
-            if (alg not in speeds[dataset]):
-                speeds[dataset][alg]=[]
-                errors[dataset][alg]=[]
-
-            lineNumber+=1
-        else:
-            sumT += int(line)
-            lineNumber+=1
-            values.append(int(line))
-            i+=1
-            if (lineNumber % 11 == 0):                      #last result
-                averageT = float(sumT/10)
-                speeds[dataset][alg].append(averageT)       #millions
-                sos = sum([(y - averageT)**2 for y in values])
-                variance = (sos / (len(values) - 1) )# ** 0.5
-                err = variance * t_n_1 / pow(len(values), 0.5)
-                errors[dataset][alg].append(err)
-    plot_speeds(speeds[dataset], errors[dataset], dataset)
-
-
-
-
-
-
-
+threads = dict()
+
+with open(sys.argv[1]) as results:
+    for row in csv.DictReader(results):
+        if (row["size"] != size):
+            continue
+        key = (row["queue"], int(row["sync"]))
+        if (key not in speeds):
+            speeds[key] = []
+            errors[key] = []
+            threads[key] = []
+        threads[key].append(int(row["threads"]))
+        speeds[key].append(float(row["mean"]))
+        errors[key].append(float(row["ci_high"]) - float(row["mean"]))
+plot_speeds(speeds, errors, threads)
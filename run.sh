@@ -1,19 +1,9 @@
 #!/bin/bash
+# Sweeps all the queues in one process, with a warm-up run and 10 repetitions
+# of every configuration. Extra options are passed on, such as
+# --baseline old.csv to flag the configurations that regressed.
 ulimit -c unlimited
-for i in 1 2 3 4
-do
-for j in 1 2 3 4 5 6 7 8
-do
-for f in 1 10 100 1000 10000
-do
-for s in 5 10 100 1000 10000 100000 1000000
-do
-for k in 1 2 3 4 5 6 7 8 9 10
-do
-./exe $i $j $f $k $s
-done
-done
-done
-done
-done
-
+rm -f results.csv results.jsonl
+./exe sweep --queues ms,durable,log,relaxed --threads 1,2,3,4,5,6,7,8 \
+    --sync 1,10,100,1000,10000 --sizes 5,10,100,1000,10000,100000,1000000 \
+    --warmup 1 --reps 10 --duration 5 --csv results.csv --json results.jsonl "$@"